@@ -1,35 +1,94 @@
 -- For each input line, write out the permutation of its words
 -- that's most likely, according to a bigram model.
 
-function main()
+-- With a beam_width, keep only that many partial orderings of each
+-- length (see pick_best_permutation()).
+function main(beam_width)
    for line in io.lines() do
-      local words, score = pick_best_permutation(split(line:lower()))
-      print(string.format('%g %s', -log2(score), table.concat(words, ' ')))
+      local words, score = pick_best_permutation(split(line:lower()), beam_width)
+      print(string.format('%g %s', -score, table.concat(words, ' ')))
    end
 end
 
-function pick_best_permutation(words)
-   local best_score = -1
-   local best_perm = nil
-   local function check_permutation(perm)
-      local score = bigram_score(perm)
-      if best_score < score then
-         best_score = score
-         best_perm = perm
+-- Return the most likely ordering of words, and its log2 probability.
+-- The bigram model scores a word by the one before it alone, so the
+-- best ordering of a set of words that ends in a given word extends a
+-- best ordering of the rest of the set: this is dynamic programming
+-- over (set of words used, last word), as in Held-Karp, in O(2^n n^2)
+-- time instead of the O(n! n) of trying every permutation. Of equal
+-- words only the first one unused may come next, so their orders
+-- aren't tried over again.
+--
+-- With a beam_width, only that many of the best states are kept for
+-- each size of set. That makes long lines feasible, but it can miss
+-- the best ordering.
+function pick_best_permutation(words, beam_width)
+   local n = #words
+   assert(n <= 50, 'too many words to order')  -- sets must be exact in a double
+   local bits, earlier, last_seen = {}, {}, {}
+   for i, word in ipairs(words) do
+      bits[i] = 2^(i-1)
+      earlier[i] = last_seen[word]
+      last_seen[word] = i
+   end
+   local function has(set, i)
+      return set % (2 * bits[i]) >= bits[i]
+   end
+
+   -- after[i][j]: the log2 probability of words[j] following words[i],
+   -- where words[0] is the start of the line.
+   local after = {}
+   for i = 0, n do
+      local prev = i == 0 and '<s>' or words[i]
+      after[i] = {}
+      for j = 1, n do
+         after[i][j] = log2(cPw(words[j], prev))
       end
    end
-   permute(words, check_permutation)
-   return best_perm, best_score
-end
 
-function bigram_score(words)
-   local P = 1
-   local prev = '<s>'
-   for i, word in ipairs(words) do
-      P = P * cPw(word, prev)
-      prev = word
+   -- A state is the best ordering found of a set ending in last: its
+   -- score, and from, the state it extends.
+   local states = {{set = 0, last = 0, score = 0}}
+   for size = 1, n do
+      local next_states, by_set = {}, {}
+      for _, s in ipairs(states) do
+         for j = 1, n do
+            if not has(s.set, j) and (earlier[j] == nil or has(s.set, earlier[j])) then
+               local set = s.set + bits[j]
+               local score = s.score + after[s.last][j]
+               local by_last = by_set[set]
+               if by_last == nil then
+                  by_last = {}
+                  by_set[set] = by_last
+               end
+               local t = by_last[j]
+               if t == nil then
+                  t = {set = set, last = j, score = score, from = s}
+                  by_last[j] = t
+                  next_states[#next_states+1] = t
+               elseif t.score < score then
+                  t.score, t.from = score, s
+               end
+            end
+         end
+      end
+      if beam_width and beam_width < #next_states then
+         table.sort(next_states, function(a, b) return a.score > b.score end)
+         for i = #next_states, beam_width+1, -1 do next_states[i] = nil end
+      end
+      states = next_states
+   end
+
+   local best = states[1]
+   for _, s in ipairs(states) do
+      if best.score < s.score then best = s end
+   end
+   local perm, score = {}, best.score
+   for i = n, 1, -1 do
+      perm[i] = words[best.last]
+      best = best.from
    end
-   return P
+   return perm, score
 end
 
 
@@ -73,42 +132,6 @@ function cPw(word, prev)
 end
 
 
--- Enumerate permutations
--- (Bad, slow first attempt)
-
-function permute(xs, receiver)
-   if #xs <= 1 then
-      receiver(xs)
-   else
-      for i, xi in ipairs(xs) do
-         local head = {xi}
-         local function join(ps)
-            receiver(append(head, ps))
-         end
-         permute(skip_at(xs, i), join)
-      end
-   end
-end
-
-function append(xs, ys)
-   local result = {}
-   array_copy(result, 1,     xs, 1, #xs)
-   array_copy(result, #xs+1, ys, 1, #ys)
-   return result
-end
-
-function skip_at(xs, i)
-   local result = {}
-   array_copy(result, 1, xs, 1, i-1)
-   array_copy(result, i, xs, i+1, #xs)
-   return result
-end
-
-function array_copy(dst, di, src, si, sj)
-   for i = 0, sj-si+1 do dst[di+i] = src[si+i] end
-end
-
-
 -- Utilities
 
 local LOG2 = math.log(2)
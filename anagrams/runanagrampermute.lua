@@ -1,3 +1,3 @@
 require('anagrampermute')
-main()
+main(tonumber(arg[1]))  -- a beam width, optionally
 
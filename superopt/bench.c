@@ -0,0 +1,387 @@
+// gcc -std=c99 -W -Wall -g2 -O2 bench.c -o bench -lm
+
+// Time the C circuit optimizers over a fixed suite of targets, and
+// check that they agree on each target's minimal gate count. (Build
+// them first: benchmark.sh does both.)
+//
+// Each (target, variant) gets --warmup untimed runs, then --trials
+// timed ones, pinned to one CPU. Each line of the results, one per
+// pair, is tab-separated:
+//   target max_gates variant gates trials median_s p90_s nodes nodes_per_s
+// gates is the size of the first circuit printed, or -1 for none.
+// nodes is the number of partial circuits the variant's --stats says
+// it entered, over all its levels, and nodes_per_s that over the
+// median time. Both are left empty for a variant that doesn't report
+// a count. A pruning variant enters fewer nodes than an exhaustive
+// one, so compare their times, not their rates, for speed.
+//
+// The exit status is 1 if the variants disagree on any gate count.
+//
+// bench --verify LIMITS instead checks the bummed search's pruning:
+// it runs the plain and the bummed optimizers on every function of 2,
+// 3 and 4 inputs, searching each to the gate limit for its input
+// count (LIMITS is those limits, comma-separated, from 2 inputs up),
+// and compares the gate counts they find. --bummed-flags adds options
+// to the bummed runs, to check --mitm, --bounds and so on too. Each
+// line of the results is an NPN class of functions:
+//   inputs class functions found min_gates max_gates plain_s bummed_s speedup
+// found is how many had a circuit within the limit, the gates are
+// over those, the times are totals, and speedup is plain_s/bummed_s.
+// The times include starting each process, which dominates the
+// smallest searches.
+
+#define _GNU_SOURCE             // for sched_setaffinity()
+
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "npn.h"
+#include "word.h"
+
+enum { max_trials = 101 };
+enum { max_flags = 16 };
+enum { min_verify_inputs = 2, max_verify_inputs = 4 };
+
+static const char *argv0 = "";
+
+static void error (const char *plaint) {
+    fprintf (stderr, "%s: %s\n", argv0, plaint);
+    exit (1);
+}
+
+typedef struct {
+    const char *name;
+    const char *program;
+    int takes_max_gates;        // boolean
+    int takes_flags;            // boolean: gets --bummed-flags
+    int max_gates;              // skip targets bigger than this
+    const char *stats;          // the option to count nodes, or NULL
+} Variant;
+
+static const Variant variants[] = {
+    { "plain",  "./circuitoptimizer",       1, 0, 99, "--stats" },
+    { "bummed", "./circuitoptimizerbummed", 1, 1, 99, "--stats" },
+    { "loopy",  "./circuitoptimizerloopy",  1, 0, 99, "--stats" },
+    { "kragen", "./kragencircuitoptimizer", 0, 0, 6, "--stats" },  // no gate limit of its own
+};
+static const Variant *const plain = &variants[0], *const bummed = &variants[1];
+enum { nvariants = sizeof variants / sizeof *variants };
+
+// Targets and the gate counts to search them to, which are their
+// minimal gate counts.
+typedef struct {
+    const char *table;
+    int max_gates;
+} Target;
+
+static const Target suite[] = {
+    { "1110", 1 },
+    { "0111", 3 },
+    { "0110", 4 },
+    { "1000", 4 },
+    { "00010111", 6 },
+    { "01100111", 6 },
+    { "01100100", 7 },
+    { "0000111111110011", 6 },
+    { "1010111111110000", 6 },
+    { "1110111111001110", 6 },
+};
+enum { nsuite = sizeof suite / sizeof *suite };
+
+static double now (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int cpu = -1;            // to pin to, or -1 for none
+static char *flags[max_flags];  // --bummed-flags, split at spaces
+static int nflags = 0;
+
+// Run the variant on t, returning its wall time, and in *gates the
+// size of the first circuit it prints. If nodes isn't NULL, ask for
+// the variant's node counts and put their total there, or -1 if it
+// reports none.
+static double run (const Variant *v, const Target *t, int *gates,
+                   long long *nodes) {
+    char max_gates[16];
+    snprintf (max_gates, sizeof max_gates, "%d", t->max_gates);
+    char *args[max_flags + 5];
+    int nargs = 0;
+    args[nargs++] = (char *) v->program;
+    for (int i = 0; v->takes_flags && i < nflags; ++i)
+        args[nargs++] = flags[i];
+    if (nodes && v->stats)
+        args[nargs++] = (char *) v->stats;
+    args[nargs++] = (char *) t->table;
+    if (v->takes_max_gates)
+        args[nargs++] = max_gates;
+    args[nargs] = NULL;
+    int fds[2];
+    if (pipe (fds) < 0)
+        error (strerror (errno));
+    double start = now ();
+    pid_t pid = fork ();
+    if (pid < 0)
+        error (strerror (errno));
+    if (pid == 0) {
+        if (0 <= cpu) {
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            CPU_SET (cpu, &set);
+            sched_setaffinity (0, sizeof set, &set);
+        }
+        close (fds[0]);
+        dup2 (fds[1], 1);
+        close (fds[1]);
+        execv (v->program, args);
+        fprintf (stderr, "%s: can't run %s: %s\n", argv0, v->program, strerror (errno));
+        _exit (127);
+    }
+    close (fds[1]);
+    // Read the output a line at a time, to find the first circuit and
+    // the levels' "N gates: M partial circuits".
+    FILE *out = fdopen (fds[0], "r");
+    char line[4096];
+    *gates = -1;
+    if (nodes)
+        *nodes = -1;
+    while (fgets (line, sizeof line, out)) {
+        int level;
+        unsigned long long n;
+        if (*gates < 0 && strstr (line, " = ")) {
+            *gates = 0;
+            for (const char *p = line; (p = strstr (p, "~(")); p += 2)
+                ++*gates;
+        } else if (nodes && sscanf (line, "%d gates: %llu partial circuits", &level, &n) == 2)
+            *nodes = (*nodes < 0 ? 0 : *nodes) + (long long) n;
+    }
+    fclose (out);
+    int status;
+    if (waitpid (pid, &status, 0) < 0)
+        error (strerror (errno));
+    double elapsed = now () - start;
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+        fprintf (stderr, "%s: %s %s failed\n", argv0, v->name, t->table);
+        *gates = -1;
+    }
+    return elapsed;
+}
+
+static int compare_doubles (const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// The nearest-rank percentile p of the n sorted times.
+static double percentile (const double *sorted, int n, int p) {
+    int rank = (p * n + 99) / 100;
+    return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+static unsigned parse_uint (const char *s, unsigned base) {
+    char *end;
+    unsigned long u = strtoul (s, &end, base);
+    if (u == 0 && errno == EINVAL)
+        error (strerror (errno));
+    if (*end != '\0')
+        error ("Literal has crud in it, or extra spaces, or something");
+    return (unsigned) u;
+}
+
+// Verifying.
+
+typedef struct {
+    Word canonical;
+    int functions, found;
+    int min_gates, max_gates;   // over those found
+    double seconds[2];          // plain's and bummed's
+} Class;
+
+// Input w is 1 in the rows whose index has bit ninputs-1-w clear.
+static void tabulate_inputs (int ninputs, Word *inputs) {
+    for (int w = 0; w < ninputs; ++w) {
+        inputs[w] = word_zero ();
+        for (int k = 0; k < 1 << ninputs; ++k)
+            if (!(1 & (k >> (ninputs-1 - w))))
+                inputs[w] = word_set_bit (inputs[w], k);
+    }
+}
+
+// Check every function of ninputs to max_gates. Returns the number
+// whose gate counts disagree.
+static int verify_inputs (FILE *out, int ninputs, int max_gates) {
+    static Class classes[1 << 16];
+    int nclasses = 0;
+    Word inputs[max_verify_inputs];
+    tabulate_inputs (ninputs, inputs);
+    Npn_table nt;
+    if (!npn_init (&nt, ninputs, 1, inputs))
+        error ("Out of memory");
+    int nrows = 1 << ninputs, disagreements = 0;
+    char table[(1 << max_verify_inputs) + 1];
+    for (unsigned f = 0; f < 1u << nrows; ++f) {
+        for (int k = 0; k < nrows; ++k)
+            table[k] = '0' + (1 & (f >> (nrows-1 - k)));
+        table[nrows] = '\0';
+        Target t = { table, max_gates };
+        int plain_gates, bummed_gates;
+        double plain_s = run (plain, &t, &plain_gates, NULL);
+        double bummed_s = run (bummed, &t, &bummed_gates, NULL);
+        if (plain_gates != bummed_gates) {
+            fprintf (stderr, "%s: %s: plain finds %d gates, bummed %d\n",
+                     argv0, table, plain_gates, bummed_gates);
+            ++disagreements;
+        }
+        Npn transform;
+        Word canonical = npn_canon (&nt, word_from_low64 (f), &transform);
+        Class *c = classes;
+        while (c < classes + nclasses && !word_eq (c->canonical, canonical))
+            ++c;
+        if (c == classes + nclasses) {
+            memset (c, 0, sizeof *c);
+            c->canonical = canonical;
+            c->min_gates = c->max_gates = -1;
+            ++nclasses;
+        }
+        ++c->functions;
+        c->seconds[0] += plain_s;
+        c->seconds[1] += bummed_s;
+        if (0 <= plain_gates) {
+            if (c->found++ == 0 || plain_gates < c->min_gates)
+                c->min_gates = plain_gates;
+            if (c->max_gates < plain_gates)
+                c->max_gates = plain_gates;
+        }
+    }
+    npn_free (&nt);
+    for (int i = 0; i < nclasses; ++i) {
+        const Class *c = &classes[i];
+        for (int k = 0; k < nrows; ++k)
+            table[k] = '0' + word_bit (c->canonical, nrows-1 - k);
+        fprintf (out, "%d\t%s\t%d\t%d\t%d\t%d\t%.6f\t%.6f\t%.3g\n",
+                 ninputs, table, c->functions, c->found,
+                 c->min_gates, c->max_gates, c->seconds[0], c->seconds[1],
+                 c->seconds[0] / c->seconds[1]);
+    }
+    fflush (out);
+    fprintf (stderr, "%d inputs to %d gates: %d functions, %d classes, %d disagreements\n",
+             ninputs, max_gates, 1 << nrows, nclasses, disagreements);
+    return disagreements;
+}
+
+// Run verify_inputs() for each limit in the comma-separated limits.
+static int verify (FILE *out, char *limits) {
+    fprintf (out, "inputs\tclass\tfunctions\tfound\tmin_gates\tmax_gates\tplain_s\tbummed_s\tspeedup\n");
+    int disagreements = 0;
+    int ninputs = min_verify_inputs;
+    for (char *limit = strtok (limits, ","); limit; limit = strtok (NULL, ",")) {
+        if (max_verify_inputs < ninputs)
+            error ("--verify takes gate limits for 2 to 4 inputs");
+        disagreements += verify_inputs (out, ninputs++, (int) parse_uint (limit, 10));
+    }
+    return disagreements;
+}
+
+static const char usage[] =
+    "Usage: bench [--trials N] [--warmup N] [--cpu K] [--out FILE]\n"
+    "       bench --verify LIMITS [--bummed-flags FLAGS] [--cpu K] [--out FILE]";
+
+int main (int argc, char **argv) {
+    argv0 = argv[0];
+    int trials = 5, warmup = 1;
+    const char *out_file = NULL;
+    char *verify_limits = NULL;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        if (strcmp (argv[i], "--trials") == 0 && i+1 < argc) {
+            trials = (int) parse_uint (argv[++i], 10);
+            if (trials < 1 || max_trials < trials)
+                error ("--trials must be between 1 and 101");
+        } else if (strcmp (argv[i], "--warmup") == 0 && i+1 < argc)
+            warmup = (int) parse_uint (argv[++i], 10);
+        else if (strcmp (argv[i], "--cpu") == 0 && i+1 < argc)
+            cpu = (int) parse_uint (argv[++i], 10);
+        else if (strcmp (argv[i], "--out") == 0 && i+1 < argc)
+            out_file = argv[++i];
+        else if (strcmp (argv[i], "--verify") == 0 && i+1 < argc)
+            verify_limits = argv[++i];
+        else if (strcmp (argv[i], "--bummed-flags") == 0 && i+1 < argc) {
+            nflags = 0;
+            for (char *f = strtok (argv[++i], " "); f; f = strtok (NULL, " ")) {
+                if (nflags == max_flags)
+                    error ("Too many --bummed-flags");
+                flags[nflags++] = f;
+            }
+        }
+        else
+            error (usage);
+    }
+    if (i != argc)
+        error (usage);
+    if (cpu < 0) {
+        // Default to the CPU we're on, so every run gets the same one.
+        cpu = sched_getcpu ();
+    }
+    FILE *out = out_file ? fopen (out_file, "w") : stdout;
+    if (!out)
+        error (strerror (errno));
+    if (verify_limits) {
+        int disagreements = verify (out, verify_limits);
+        if (out != stdout && fclose (out) != 0)
+            error (strerror (errno));
+        return disagreements != 0;
+    }
+    fprintf (out, "target\tmax_gates\tvariant\tgates\ttrials\tmedian_s\tp90_s\tnodes\tnodes_per_s\n");
+    int disagreements = 0;
+    for (int s = 0; s < nsuite; ++s) {
+        const Target *t = &suite[s];
+        int agreed = -2;        // -2 until some variant's run
+        for (int k = 0; k < nvariants; ++k) {
+            const Variant *v = &variants[k];
+            if (v->max_gates < t->max_gates)
+                continue;
+            fprintf (stderr, "%s %s\n", v->name, t->table);
+            int gates = -1, g;
+            long long nodes = -1;
+            for (int r = 0; r < warmup; ++r)
+                run (v, t, &gates, &nodes);  // the same command as timed
+            double times[max_trials];
+            for (int r = 0; r < trials; ++r) {
+                times[r] = run (v, t, &g, &nodes);
+                if (r == 0)
+                    gates = g;
+                else if (g != gates)
+                    gates = -1;     // the same variant disagreed with itself
+            }
+            qsort (times, trials, sizeof *times, compare_doubles);
+            double median = percentile (times, trials, 50);
+            double p90 = percentile (times, trials, 90);
+            fprintf (out, "%s\t%d\t%s\t%d\t%d\t%.6f\t%.6f\t",
+                     t->table, t->max_gates, v->name, gates, trials,
+                     median, p90);
+            if (0 <= nodes && 0 < median)
+                fprintf (out, "%lld\t%.4g\n", nodes, nodes / median);
+            else
+                fprintf (out, "\t\n");
+            fflush (out);
+            if (agreed == -2)
+                agreed = gates;
+            else if (gates != agreed) {
+                fprintf (stderr, "%s: variants disagree on %s's gate count\n",
+                         argv0, t->table);
+                ++disagreements;
+            }
+        }
+    }
+    if (out != stdout && fclose (out) != 0)
+        error (strerror (errno));
+    return disagreements != 0;
+}
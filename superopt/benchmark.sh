@@ -1,43 +1,61 @@
 #!/bin/sh
-# Produce benchmark timings of different implementations of the same
-# circuitoptimizer program, into time-* files. (Outputs in out-*.)
-
+# Build every C variant of circuitoptimizer and benchmark them over the
+# fixed suite in bench.c, into bench-results.tsv (tab-separated: diff
+# it between commits). Arguments go to bench, e.g. --trials 11 or
+# --cpu 2. Exits nonzero if the variants disagree on a gate count.
+# With --verify 5,6,4 it checks the bummed search's pruning against the
+# plain search instead, over every function of 2 to 4 inputs (about
+# two minutes; see bench.c).
+#
+# Then it times the other languages' ports against the C one on a
+# single target, into time-* files (outputs in out-*), skipping any
+# whose compiler or interpreter isn't installed.
+
+set -e
+cd "`dirname "$0"`"
+
+cflags="-std=c99 -W -Wall -g2 -O2"
+gcc $cflags -pthread circuitoptimizer.c -o circuitoptimizer -lm
+gcc $cflags -pthread circuitoptimizerbummed.c -o circuitoptimizerbummed -lm
+gcc $cflags circuitoptimizerloopy.c -o circuitoptimizerloopy -lm
+gcc -g2 -O2 kragencircuitoptimizer.c -o kragencircuitoptimizer
+gcc $cflags bench.c -o bench -lm
+
+./bench --out bench-results.tsv "$@"
+cat bench-results.tsv
+
+# The ports. One that fails just leaves its files short.
+
+set +e
 timex=`which time`  # To avoid shell builtin that won't redirect output
 
 args="01100111 6"
 #args="01100100 7"
 #args="01101011 8"
 
-csc compiled_circuitoptimizer.scm
-gcc -Wall -Wmissing-prototypes -Wstrict-prototypes -pedantic -ansi -std=c99 -g2 -O2 circuitoptimizer.c -o circuitoptimizer
-
-echo C
->out-c 2>time-c
-for trial in 1 2 3; do
-    echo trial $trial
-    $timex ./circuitoptimizer $args >>out-c 2>>time-c
-done
-
-echo chickencompiled
->out-chickencompiled 2>time-chickencompiled
-for trial in 1 2 3; do
-    echo trial $trial
-    $timex ./compiled_circuitoptimizer $args >>out-chickencompiled 2>>time-chickencompiled
-done
-
-echo luajit
->out-luajit 2>time-luajit
-for trial in 1 2 3; do
-    echo trial $trial
-    $timex luajit circuitoptimizer.lua $args >>out-luajit 2>>time-luajit
-done
-
-echo python
->out-python 2>time-python
-for trial in 1; do
-    echo trial $trial
-    $timex python circuitoptimizer.py $args >>out-python 2>>time-python
-done
+# Usage: port NAME TRIALS COMMAND...
+port() {
+    name=$1 trials=$2
+    shift 2
+    echo $name
+    >out-$name 2>time-$name
+    for trial in `seq $trials`; do
+        echo trial $trial
+        $timex "$@" $args >>out-$name 2>>time-$name
+    done
+}
+
+port c 3 ./circuitoptimizer
+if command -v csc >/dev/null; then
+    csc compiled_circuitoptimizer.scm
+    port chickencompiled 3 ./compiled_circuitoptimizer
+fi
+if command -v luajit >/dev/null; then
+    port luajit 3 luajit circuitoptimizer.lua
+fi
+if command -v python >/dev/null; then
+    port python 1 python circuitoptimizer.py
+fi
 
 # TO DO
-# add mlton & bummed versions
+# add mlton
@@ -0,0 +1,112 @@
+// A file of optimal NAND circuits for every 2-, 3- and 4-input
+// function, mmapped and indexed directly by truth table.
+//
+// Layout: a Db_header, then for each ninputs a table of
+// 2^(2^ninputs) Db_entry, in truth-table order. An entry holds the
+// gate count and the gates' (linput, rinput) pairs packed 5 bits per
+// input, gate by gate from bit 0 of pairs[], wires numbered as in the
+// optimizers (inputs first). An entry the builder didn't solve has
+// db_unsolved set and, in the low bits, the gate count it searched up
+// to without finding one.
+//
+// The file is in host byte order; it's a cache, not an interchange
+// format.
+
+#ifndef CIRCUITDB_H
+#define CIRCUITDB_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum { db_min_inputs = 2, db_max_inputs = 4 };
+enum { db_max_gates = 12 };
+enum { db_unsolved = 0x80 };
+
+static const char db_magic[8] = "NANDDB1";
+
+typedef struct {
+    char magic[8];
+    uint32_t offset[db_max_inputs+1]; // of each ninputs's entries
+} Db_header;
+
+typedef struct {
+    unsigned char gates;
+    unsigned char pairs[15];    // db_max_gates * 10 bits
+} Db_entry;
+
+static inline size_t db_nentries (int ninputs) {
+    return (size_t) 1 << (1 << ninputs);
+}
+
+static inline size_t db_size (void) {
+    size_t size = sizeof (Db_header);
+    for (int n = db_min_inputs; n <= db_max_inputs; ++n)
+        size += db_nentries (n) * sizeof (Db_entry);
+    return size;
+}
+
+static inline void db_init (unsigned char *image) {
+    Db_header *h = (Db_header *) image;
+    memcpy (h->magic, db_magic, sizeof h->magic);
+    uint32_t offset = sizeof (Db_header);
+    for (int n = db_min_inputs; n <= db_max_inputs; ++n) {
+        h->offset[n] = offset;
+        offset += (uint32_t) (db_nentries (n) * sizeof (Db_entry));
+    }
+}
+
+static inline Db_entry *db_entry (const unsigned char *image, int ninputs,
+                                  uint64_t table) {
+    const Db_header *h = (const Db_header *) image;
+    return (Db_entry *) (image + h->offset[ninputs]) + table;
+}
+
+static inline void db_pack (Db_entry *e, int ninputs, int ngates,
+                            const int *linputs, const int *rinputs) {
+    memset (e, 0, sizeof *e);
+    e->gates = (unsigned char) ngates;
+    for (int g = 0; g < ngates; ++g) {
+        unsigned pair = (unsigned) linputs[ninputs+g]
+                      | (unsigned) rinputs[ninputs+g] << 5;
+        for (int b = 0; b < 10; ++b)
+            if (1 & (pair >> b))
+                e->pairs[(10*g + b) / 8] |= 1 << ((10*g + b) % 8);
+    }
+}
+
+static inline void db_unpack (const Db_entry *e, int ninputs,
+                              int *linputs, int *rinputs) {
+    for (int g = 0; g < e->gates; ++g) {
+        unsigned pair = 0;
+        for (int b = 0; b < 10; ++b)
+            pair |= (unsigned) (1 & (e->pairs[(10*g + b) / 8] >> ((10*g + b) % 8))) << b;
+        linputs[ninputs+g] = pair & 31;
+        rinputs[ninputs+g] = pair >> 5;
+    }
+}
+
+// Map filename read-only. Returns NULL if it can't, or if it isn't a
+// database.
+static inline const unsigned char *db_open (const char *filename) {
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void *image = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && (size_t) st.st_size == db_size ())
+        image = mmap (NULL, db_size (), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (image == MAP_FAILED)
+        return NULL;
+    if (memcmp (image, db_magic, sizeof db_magic) != 0) {
+        munmap (image, db_size ());
+        return NULL;
+    }
+    return image;
+}
+
+#endif
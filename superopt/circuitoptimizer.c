@@ -1,17 +1,25 @@
-// gcc -std=c99 -W -Wall -g2 -O2 circuitoptimizer.c -o circuitoptimizer
+// gcc -std=c99 -W -Wall -g2 -O2 -pthread circuitoptimizer.c -o circuitoptimizer -lm
+
+#define _POSIX_C_SOURCE 200809L
 
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
-enum { max_wires = 20 };
-enum { max_inputs = 5 };
+#include "circuitdb.h"
+#include "lastgate.h"
+#include "npn.h"
+#include "targetset.h"
+#include "word.h"
 
-typedef unsigned Word;
+enum { max_wires = 26 };   // vnames must be letters
+enum { max_outputs = 16 };
 
 static const char *argv0 = "";
 
@@ -21,82 +29,786 @@ static void error (const char *plaint) {
 }
 
 static Word target_output;
+static Word care;               // the rows of target_output that aren't x
 
 static int ninputs;
 static Word mask;
 
 static int found = 0;           // boolean
+static int stats = 0;           // boolean: print node counts per level
+static unsigned long long level_nodes;     // partial circuits swept
+
+// What to do with the circuits found at the winning size: write them
+// all, stop at the first, or only count them.
+enum { solutions_all, solutions_first, solutions_count };
+static int solutions = solutions_all;
+static unsigned long long nsolutions = 0;
+static int stop = 0;            // boolean: --first has its circuit
 static int nwires;
-static Word wires[max_wires];
+static Word wires[wires_padded] __attribute__ ((aligned (wires_align)));
 static int linputs[max_wires];
 static int rinputs[max_wires];
 
+static int batch = 0;           // boolean: solve for every table in 'targets'
+static Target_set targets;
+
+// With several comma-separated targets, they're all wanted on the
+// wires of one circuit.
+static int noutputs = 0;
+static Word outputs[max_outputs];
+
+// With --minimize depth, the least depth comes first, then the
+// fewest gates at that depth.
+enum { minimize_gates, minimize_depth };
+static int minimize = minimize_gates;
+static int max_depth;
+static int levels[max_wires];   // each wire's depth; the inputs are 0
+
+// With --stochastic, how long to sample each size for, on how many
+// threads; sizes of at most stochastic_exhaustive_gates are swept.
+enum { max_threads = 64 };
+enum { stochastic_exhaustive_gates = 6 };
+enum { restart_steps = 1 << 17 };
+static const double beta = 8.0; // the Metropolis rule's inverse temperature
+static double stochastic_seconds = 0;
+static int nthreads = 1;
+static int chain_gates;
+static double chain_deadline;
+static int chain_solved;        // boolean, atomic
+static pthread_mutex_t chain_lock = PTHREAD_MUTEX_INITIALIZER;
+static int have_seed = 0;       // boolean
+static int seed_linputs[max_wires];
+static int seed_rinputs[max_wires];
+
+static const unsigned char *db = NULL;     // to look up targets in
+static unsigned char *new_db = NULL;       // being built by --build-db
+
+// With --canon, search for the canonical form of each target instead,
+// and print the circuit found rewritten by the target's transform.
+enum { canon_none, canon_p, canon_npn };
+static int canon = canon_none;
+static Npn_table npn;
+static Npn target_transform;
+static const Npn *transform = NULL;         // for print_circuit()
+static Npn_member *members = NULL;          // the batch, by canonical form
+static size_t nmembers = 0;
+
 static char vname (int w) {
     return (w < ninputs ? 'A' : 'a') + w;
 }
 
+// Circuits are written into out_buffer, and it to stdout a block at
+// a time, rather than a printf per gate: a level can have thousands of
+// them. The search itself only calls out_circuit() and out_shared();
+// anything printed with stdio has to flush_out() first.
+enum { out_size = 1 << 16 };
+enum { out_slack = 8192 };      // room for any one line
+static char out_buffer[out_size];
+static size_t out_length = 0;
+
+static void flush_out (void) {
+    if (out_length != 0 && fwrite (out_buffer, 1, out_length, stdout) != out_length)
+        error (strerror (errno));
+    out_length = 0;
+}
+
+// Make room for a line.
+static void out_line (void) {
+    if (out_size - out_slack < out_length)
+        flush_out ();
+}
+
+static void out_char (char c) {
+    out_buffer[out_length++] = c;
+}
+
+static void out_gates (int n, const int *ls, const int *rs) {
+    for (int w = ninputs; w < n; ++w) {
+        char *p = out_buffer + out_length;
+        if (w != ninputs) {
+            *p++ = ';';
+            *p++ = ' ';
+        }
+        *p++ = vname (w);
+        memcpy (p, " = ~(", 5);
+        p += 5;
+        *p++ = vname (ls[w]);
+        *p++ = ' ';
+        *p++ = vname (rs[w]);
+        *p++ = ')';
+        out_length = (size_t) (p - out_buffer);
+    }
+}
+
+static void out_transformed (const Npn *t) {
+    int ls[max_wires + npn_max_inputs + 1], rs[max_wires + npn_max_inputs + 1];
+    out_line ();
+    out_gates (npn_map_circuit (t, ninputs, nwires, linputs, rinputs, ls, rs),
+               ls, rs);
+    out_char ('\n');
+}
+
+static void out_circuit (void) {
+    if (transform)
+        out_transformed (transform);
+    else {
+        out_line ();
+        out_gates (nwires, linputs, rinputs);
+        out_char ('\n');
+    }
+}
+
+static void print_transformed (const Npn *t) {
+    out_transformed (t);
+    flush_out ();
+}
+
 static void print_circuit (void) {
-    for (int w = ninputs; w < nwires; ++w)
-        printf ("%s%c = ~(%c %c)",
-                w == ninputs ? "" : "; ",
-                vname (w), vname (linputs[w]), vname (rinputs[w]));
-    printf("\n");
+    out_circuit ();
+    flush_out ();
+}
+
+static void print_bits (Word table) {
+    for (int k = (1 << ninputs) - 1; 0 <= k; --k)
+        putchar ('0' + word_bit (table, k));
+}
+
+static void print_table (Word table) {
+    print_bits (table);
+    printf (": ");
+}
+
+// Print the batch targets searched for as table, each with the
+// circuit just found or else "not found".
+static void print_targets (Word table, int solved) {
+    const Npn_member *m = members ? npn_class (members, nmembers, table) : NULL;
+    if (!m) {
+        print_table (table);
+        if (solved)
+            print_circuit ();
+        else
+            printf ("not found\n");
+        return;
+    }
+    for (; m < members + nmembers && word_eq (m->canonical, table); ++m) {
+        if (m != members && word_eq (m[-1].original, m->original))
+            continue;
+        print_table (m->original);
+        if (solved)
+            print_transformed (&m->transform);
+        else
+            printf ("not found\n");
+    }
 }
 
 static Word compute (Word left_input, Word right_input) {
-    return ~(left_input & right_input);
+    return word_nand (left_input, right_input);
+}
+
+// Note the circuits finished by last gate w taking the right inputs
+// in hits. Returns 1 if the search should stop.
+static int note_hits (int w, unsigned hits) {
+    found = 1;
+    if (solutions == solutions_count) {
+        nsolutions += (unsigned) __builtin_popcount (hits);
+        return 0;
+    }
+    for (; hits != 0; hits &= hits - 1) {
+        rinputs[w] = __builtin_ctz (hits);
+        ++nsolutions;
+        out_circuit ();
+        if (solutions == solutions_first)
+            return stop = 1;
+    }
+    return 0;
+}
+
+static void note_batch_found (Word output) {
+    ts_retire (&targets, output);
+    found = 1;
+    if (new_db)
+        db_pack (db_entry (new_db, ninputs, word_low64 (output)),
+                 ninputs, nwires - ninputs, linputs, rinputs);
+    print_targets (output, 1);
 }
 
 static void sweeping (int w) {
+    ++level_nodes;
+    if (batch && ts_npending (&targets) == 0)
+        return;
     for (int ll = 0; ll < w; ++ll) {
         Word llwire = wires[ll];
         linputs[w] = ll;
-        if (w+1 == nwires)
+        if (w+1 == nwires && batch) {
             for (int rr = 0; rr <= ll; ++rr) {
-                if ((mask & compute (llwire, wires[rr])) == target_output) {
-                    found = 1;
+                Word output = word_and (mask, compute (llwire, wires[rr]));
+                if (ts_is_pending (&targets, output)) {
                     rinputs[w] = rr;
-                    print_circuit ();
+                    note_batch_found (output);
                 }
             }
-        else
+        } else if (w+1 == nwires) {
+            unsigned hits = last_gate_hits (llwire, wires, ll+1,
+                                            care, target_output);
+            if (hits != 0 && note_hits (w, hits))
+                return;
+        } else
             for (int rr = 0; rr <= ll; ++rr) {
                 wires[w] = compute (llwire, wires[rr]);
                 rinputs[w] = rr;
                 sweeping (w + 1);
+                if (stop)
+                    return;
             }
     }
 }
 
+// Like sweeping(), with no wire deeper than max_depth. 'shallow' has
+// bit v set for each wire v before w that a gate can still take as an
+// input, and 'unused' each gate before w that none takes yet.
+//   The circuits of least depth with the fewest gates have every gate
+// but the last used, and a gate can use up at most one more unused
+// wire than it adds, so a partial circuit with more unused gates than
+// gates to go is cut. As in sweeping_outputs(), so is a gate out of
+// order with the gates it commutes with (reordering leaves the levels
+// alone), or repeating a wire no deeper than it; so these wires are
+// masked.
+static void sweeping_depth (int w, unsigned shallow, unsigned unused) {
+    ++level_nodes;
+    int left = nwires - (w+1);
+    for (int ll = 0; ll < w; ++ll) {
+        if (!(1 & (shallow >> ll)))
+            continue;
+        Word llwire = wires[ll];
+        linputs[w] = ll;
+        unsigned rest = unused & ~(1u << ll);
+        if (w+1 == nwires) {
+            if (rest & (rest - 1))
+                continue;
+            unsigned hits = shallow & last_gate_hits (llwire, wires, ll+1,
+                                                      care, target_output);
+            if (rest)
+                hits &= rest;
+            if (hits != 0 && note_hits (w, hits))
+                return;
+        } else
+            for (int rr = 0; rr <= ll; ++rr) {
+                if (!(1 & (shallow >> rr)))
+                    continue;
+                unsigned now = (rest & ~(1u << rr)) | 1u << w;
+                if (left < __builtin_popcount (now) - 1)
+                    continue;
+                int level = 1 + (levels[ll] < levels[rr] ? levels[rr] : levels[ll]);
+                Word wire = word_and (mask, compute (llwire, wires[rr]));
+                int k;
+                for (k = w-1; ninputs <= k && ll < k; --k)
+                    if (!word_lt (wires[k], wire))
+                        goto skip;
+                for (; 0 <= k; --k)
+                    if (word_eq (wires[k], wire) && levels[k] <= level)
+                        goto skip;
+                wires[w] = wire;
+                levels[w] = level;
+                rinputs[w] = rr;
+                sweeping_depth (w + 1, shallow | (unsigned) (level < max_depth) << w,
+                                now);
+                if (stop)
+                    return;
+            skip: ;
+            }
+    }
+}
+
+// Write the circuit, then where each of the outputs is on it.
+static void out_shared (void) {
+    out_line ();
+    out_gates (nwires, linputs, rinputs);
+    if (nwires != ninputs) {
+        out_char (' ');
+        out_char ('|');
+        out_char (' ');
+    }
+    for (int i = 0; i < noutputs; ++i) {
+        if (i != 0) {
+            out_char (',');
+            out_char (' ');
+        }
+        for (int k = (1 << ninputs) - 1; 0 <= k; --k)
+            out_char ('0' + word_bit (outputs[i], k));
+        out_char (':');
+        out_char (' ');
+        if (word_eq (outputs[i], word_zero ()) || word_eq (outputs[i], mask))
+            out_char ('0' + word_bit (outputs[i], 0));
+        else
+            for (int w = 0; w < nwires; ++w)
+                if (word_eq (wires[w], outputs[i])) {
+                    out_char (vname (w));
+                    break;
+                }
+    }
+    out_char ('\n');
+}
+
+// The bit for the output equal to wire, if any. (The outputs are
+// distinct.)
+static unsigned covering (Word wire) {
+    for (int i = 0; i < noutputs; ++i)
+        if (word_eq (outputs[i], wire))
+            return 1u << i;
+    return 0;
+}
+
+// Like sweeping(), for a circuit with all of the outputs on its wires,
+// anywhere. 'covered' has bit i set if outputs[i] is on some wire
+// before w. The wires here are masked, so they can be compared.
+//   Each gate can add at most one output, so a partial circuit missing
+// more outputs than it has gates left is cut. So is a gate repeating a
+// wire, or out of order with the gates it commutes with, as in
+// circuitoptimizerbummed.c: neither changes the set of wires.
+static void sweeping_outputs (int w, unsigned covered) {
+    ++level_nodes;
+    int left = nwires - (w+1);
+    for (int ll = 0; ll < w; ++ll) {
+        linputs[w] = ll;
+        for (int rr = 0; rr <= ll; ++rr) {
+            Word wire = word_and (mask, compute (wires[ll], wires[rr]));
+            int k;
+            for (k = w-1; ninputs <= k && ll < k; --k)
+                if (!word_lt (wires[k], wire))
+                    goto skip;
+            for (; 0 <= k; --k)
+                if (word_eq (wires[k], wire))
+                    goto skip;
+            unsigned now = covered | covering (wire);
+            if (left < noutputs - __builtin_popcount (now))
+                goto skip;
+            wires[w] = wire;
+            rinputs[w] = rr;
+            if (left == 0) {
+                found = 1;
+                ++nsolutions;
+                if (solutions == solutions_count)
+                    goto skip;
+                out_shared ();
+                if (solutions == solutions_first) {
+                    stop = 1;
+                    return;
+                }
+            } else {
+                sweeping_outputs (w + 1, now);
+                if (stop)
+                    return;
+            }
+        skip: ;
+        }
+    }
+}
+
+// Input w is 1 in the rows whose index has bit ninputs-1-w clear.
 static void tabulate_inputs (void) {
-    for (int i = 1; i <= ninputs; ++i) {
-        Word shift = 1 << (i-1);
-        wires[ninputs-i] = (1u << shift) - 1;
-        for (int j = ninputs-i+1; j < ninputs; ++j)
-            wires[j] |= wires[j] << shift;
+    for (int w = 0; w < ninputs; ++w) {
+        wires[w] = word_zero ();
+        for (int k = 0; k < 1 << ninputs; ++k)
+            if (!(1 & (k >> (ninputs-1 - w))))
+                wires[w] = word_set_bit (wires[w], k);
     }
 }
 
+// Is table a constant or an input, needing no gates?
+static int trivial (Word table) {
+    if (word_eq (table, word_zero ()) || word_eq (table, mask))
+        return 1;
+    for (int w = 0; w < ninputs; ++w)
+        if (word_eq (table, wires[w]))
+            return 1;
+    return 0;
+}
+
+static void init_canon (void) {
+    if (npn_max_inputs < ninputs)
+        error ("--canon handles at most 6 inputs");
+    if (!npn_init (&npn, ninputs, canon == canon_npn, wires))
+        error ("Out of memory");
+}
+
+// Does table agree with the target wherever it cares?
+static int matches (Word table) {
+    return word_eq (word_and (care, table), target_output);
+}
+
+// Iterative deepening on depth, then gates. A circuit of depth d
+// needs at least d gates, and has at most 2^d - 1 that the output
+// depends on.
+// With --stats, report the level just swept; start the next one's count.
+static void level_stats (int ngates) {
+    if (stats) {
+        flush_out ();
+        printf ("%d gates: %llu partial circuits\n", ngates, level_nodes);
+    }
+    level_nodes = 0;
+}
+
+static void find_shallow_circuits (int max_gates) {
+    for (max_depth = 1; max_depth <= max_gates; ++max_depth) {
+        int most = max_depth < 20 ? (1 << max_depth) - 1 : max_gates;
+        if (max_gates < most)
+            most = max_gates;
+        for (int ngates = max_depth; ngates <= most; ++ngates) {
+            printf ("Trying depth %d, %d gates...\n", max_depth, ngates);
+            fflush (stdout);
+            nwires = ninputs + ngates;
+            assert (nwires <= 26); // vnames must be letters
+            sweeping_depth (ninputs, (1u << ninputs) - 1, 0);
+            level_stats (ngates);
+            if (found)
+                return;
+        }
+    }
+}
+
+// If the target's a constant or an input, print that and return 1.
+static int solve_without_gates (void) {
+    printf ("Trying 0 gates...\n");
+    for (int value = 0; value <= 1; ++value)
+        if (matches (value ? mask : word_zero ())) {
+            printf ("%c = %d\n", vname (ninputs), value);
+            return 1;
+        }
+    for (int w = 0; w < ninputs; ++w)
+        if (matches (wires[w])) {
+            printf ("%c = %c\n", vname (ninputs), vname (w));
+            return 1;
+        }
+    return 0;
+}
+
 static void find_circuits (int max_gates) {
-    mask = (1u << (1u << ninputs)) - 1u;
+    mask = word_mask (ninputs);
     tabulate_inputs ();
-    printf ("Trying 0 gates...\n");
-    if (target_output == 0 || target_output == mask) {
-        printf ("%c = %d\n", vname (ninputs), target_output & 1);
+    pick_last_gate_kernel ();
+    if (solve_without_gates ())
         return;
+    int partial = !word_eq (care, mask);
+    if (canon && partial)
+        error ("--canon needs a table without don't-cares");
+    if (canon) {
+        init_canon ();
+        Word c = npn_canon (&npn, target_output, &target_transform);
+        npn_free (&npn);
+        if (!trivial (c)) {
+            target_output = c;
+            transform = &target_transform;
+            printf ("Canonical form ");
+            print_bits (c);
+            printf ("\n");
+        }
     }
-    for (int w = 0; w < ninputs; ++w)
-        if (target_output == wires[w]) {
-            printf ("%c = %c\n", vname (ninputs), vname (w));
+    int first_gates = 1;
+    if (db && !partial && db_min_inputs <= ninputs && ninputs <= db_max_inputs) {
+        const Db_entry *e = db_entry (db, ninputs, word_low64 (target_output));
+        if (e->gates & db_unsolved)
+            first_gates = (e->gates & ~db_unsolved) + 1;
+        else if (max_gates < e->gates)
             return;
+        else {
+            printf ("Found %d gates in the database\n", e->gates);
+            if (solutions == solutions_first) {
+                nwires = ninputs + e->gates;
+                db_unpack (e, ninputs, linputs, rinputs);
+                print_circuit ();
+                found = 1;
+                nsolutions = 1;
+                return;
+            }
+            // The database holds just one circuit of that size: sweep
+            // the size for --all's listing or --count's count.
+            first_gates = e->gates;
         }
-    for (int ngates = 1; ngates <= max_gates; ++ngates) {
+    }
+    if (minimize == minimize_depth) {
+        find_shallow_circuits (max_gates);
+        return;
+    }
+    for (int ngates = first_gates; ngates <= max_gates; ++ngates) {
         printf ("Trying %d gates...\n", ngates);
         nwires = ninputs + ngates;
         assert (nwires <= 26); // vnames must be letters
+        sweeping (ninputs);
+        level_stats (ngates);
+        if (found)
+            return;
+    }
+}
+
+// The stochastic search, for circuits too big to sweep. Each thread
+// runs a Markov chain over circuits of chain_gates gates: a step
+// rewires one input of one gate, and is kept by the Metropolis rule on
+// the Hamming distance from the output to the target. A chain starts
+// over from a fresh circuit after restart_steps steps. A circuit found
+// with n gates seeds the chains for n-1 gates with one of its gates
+// dropped, until the sizes are small enough for sweeping() to settle
+// exactly.
+
+static double elapsed (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// splitmix64
+static uint64_t next_random (uint64_t *state) {
+    uint64_t z = (*state += UINT64_C (0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * UINT64_C (0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C (0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+static int random_below (uint64_t *state, int n) {
+    return (int) ((next_random (state) >> 32) * (uint64_t) n >> 32);
+}
+
+typedef struct {
+    pthread_t thread;
+    uint64_t random;
+    unsigned long long steps;
+    Word wires[max_wires];
+    int linputs[max_wires];
+    int rinputs[max_wires];
+} Chain;
+
+// The rows where output differs from the target.
+static int distance (Word output) {
+    return word_popcount (word_and (care, word_xor (output, target_output)));
+}
+
+// Recompute wires from gate g on, and return the new distance.
+static int evaluate_from (Chain *c, int g) {
+    int n = ninputs + chain_gates;
+    for (int w = g; w < n; ++w)
+        c->wires[w] = compute (c->wires[c->linputs[w]], c->wires[c->rinputs[w]]);
+    return distance (c->wires[n-1]);
+}
+
+// Start c over: from the seed less a random gate, if there's a seed,
+// else from random wiring.
+static void restart (Chain *c) {
+    int n = ninputs + chain_gates;
+    if (have_seed) {
+        int drop = ninputs + random_below (&c->random, chain_gates);
+        for (int w = ninputs, v = ninputs; w <= n; ++w) {
+            if (w == drop)
+                continue;
+            int l = seed_linputs[w] == drop ? seed_linputs[drop] : seed_linputs[w];
+            int r = seed_rinputs[w] == drop ? seed_linputs[drop] : seed_rinputs[w];
+            c->linputs[v] = l < drop ? l : l-1;
+            c->rinputs[v] = r < drop ? r : r-1;
+            ++v;
+        }
+    } else
+        for (int w = ninputs; w < n; ++w) {
+            c->linputs[w] = random_below (&c->random, w);
+            c->rinputs[w] = random_below (&c->random, w);
+        }
+}
+
+static void *run_chain (void *arg) {
+    Chain *c = arg;
+    int n = ninputs + chain_gates;
+    Word saved[max_wires];
+    while (!__atomic_load_n (&chain_solved, __ATOMIC_RELAXED)) {
+        restart (c);
+        int score = evaluate_from (c, ninputs);
+        for (long step = 0; step < restart_steps; ++step) {
+            if (score == 0) {
+                pthread_mutex_lock (&chain_lock);
+                if (!chain_solved) {
+                    memcpy (linputs, c->linputs, sizeof linputs);
+                    memcpy (rinputs, c->rinputs, sizeof rinputs);
+                    __atomic_store_n (&chain_solved, 1, __ATOMIC_RELAXED);
+                }
+                pthread_mutex_unlock (&chain_lock);
+                c->steps += step;
+                return NULL;
+            }
+            if (step % 4096 == 0
+                && (__atomic_load_n (&chain_solved, __ATOMIC_RELAXED)
+                    || chain_deadline < elapsed ())) {
+                c->steps += step;
+                return NULL;
+            }
+            // One draw picks the gate (high half), the side (bit 0)
+            // and the new input (the rest).
+            uint64_t r = next_random (&c->random);
+            int g = ninputs + (int) ((r >> 32) * (uint64_t) chain_gates >> 32);
+            int *in = 1 & r ? c->rinputs : c->linputs;
+            int old = in[g];
+            in[g] = (int) ((r & 0xFFFFFFFE) * (uint64_t) g >> 32);
+            if (in[g] == old)
+                continue;
+            memcpy (&saved[g], &c->wires[g], (n-g) * sizeof *saved);
+            int d = evaluate_from (c, g);
+            if (d <= score
+                || (next_random (&c->random) >> 11) * 0x1.0p-53 < exp (-beta * (d - score)))
+                score = d;
+            else {
+                in[g] = old;
+                memcpy (&c->wires[g], &saved[g], (n-g) * sizeof *saved);
+            }
+        }
+        c->steps += restart_steps;
+    }
+    return NULL;
+}
+
+// Run the chains for chain_gates gates, until one finds the target
+// (and leaves it in linputs/rinputs) or time's up. Returns 1 if found.
+static int sample (void) {
+    static Chain chains[max_threads];
+    chain_solved = 0;
+    chain_deadline = elapsed () + stochastic_seconds;
+    double start = elapsed ();
+    unsigned long long steps = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        Chain *c = &chains[i];
+        c->random = UINT64_C (0x5EED) + i;
+        c->steps = 0;
+        for (int w = 0; w < ninputs; ++w)
+            c->wires[w] = wires[w];
+        if (pthread_create (&c->thread, NULL, run_chain, c))
+            error ("Can't start a thread");
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_join (chains[i].thread, NULL);
+        steps += chains[i].steps;
+    }
+    double seconds = elapsed () - start;
+    printf ("%llu steps in %.2f s (%.3g steps/s)\n",
+            steps, seconds, seconds ? steps / seconds : 0.0);
+    return chain_solved;
+}
+
+// Drop the gates of linputs/rinputs[ninputs..nwires) that the output
+// doesn't depend on.
+static void compact (void) {
+    int live[max_wires] = { 0 }, renumber[max_wires];
+    live[nwires-1] = 1;
+    for (int w = nwires-1; ninputs <= w; --w)
+        if (live[w])
+            live[linputs[w]] = live[rinputs[w]] = 1;
+    int v = ninputs;
+    for (int w = 0; w < nwires; ++w) {
+        renumber[w] = w < ninputs ? w : v;
+        if (ninputs <= w && live[w]) {
+            linputs[v] = renumber[linputs[w]];
+            rinputs[v] = renumber[rinputs[w]];
+            ++v;
+        }
+    }
+    nwires = v;
+}
+
+static void find_stochastic_circuits (int max_gates) {
+    if (max_wires < ninputs + max_gates)
+        error ("Too many gates");
+    mask = word_mask (ninputs);
+    tabulate_inputs ();
+    pick_last_gate_kernel ();
+    if (solve_without_gates ())
+        return;
+    int ngates = max_gates;
+    while (stochastic_exhaustive_gates < ngates) {
+        printf ("Sampling %d gates...\n", ngates);
+        fflush (stdout);
+        chain_gates = ngates;
+        if (!sample ()) {
+            if (have_seed)
+                printf ("Nothing smaller found\n");
+            return;
+        }
+        nwires = ninputs + ngates;
+        compact ();
+        print_circuit ();
+        memcpy (seed_linputs, linputs, sizeof linputs);
+        memcpy (seed_rinputs, rinputs, sizeof rinputs);
+        have_seed = 1;
+        ngates = nwires - ninputs - 1;
+    }
+    for (int g = 1; g <= ngates; ++g) {
+        printf ("Trying %d gates...\n", g);
+        nwires = ninputs + g;
         if (sweeping (ninputs), found)
             return;
     }
+    if (have_seed)
+        printf ("No circuit has fewer than %d gates\n", ngates + 1);
+}
+
+// Like find_circuits(), for the smallest circuits with all of the
+// outputs on them. The constants need no wire.
+static void find_shared_circuits (int max_gates) {
+    mask = word_mask (ninputs);
+    tabulate_inputs ();
+    unsigned covered = 0;
+    for (int i = 0; i < noutputs; ++i)
+        if (word_eq (outputs[i], word_zero ()) || word_eq (outputs[i], mask))
+            covered |= 1u << i;
+        else
+            for (int w = 0; w < ninputs; ++w)
+                covered |= covering (wires[w]) & (1u << i);
+    printf ("Trying 0 gates...\n");
+    nwires = ninputs;
+    if (covered == (1u << noutputs) - 1) {
+        out_shared ();
+        return;
+    }
+    for (int ngates = 1; ngates <= max_gates; ++ngates) {
+        printf ("Trying %d gates...\n", ngates);
+        fflush (stdout);
+        nwires = ninputs + ngates;
+        assert (nwires <= 26); // vnames must be letters
+        sweeping_outputs (ninputs, covered);
+        level_stats (ngates);
+        if (found)
+            return;
+    }
+}
+
+static void print_unsolved (Word table) {
+    print_targets (table, 0);
+}
+
+// Like find_circuits(), for every table in 'targets' at once. Each
+// table is retired with the first circuit found for it.
+static void find_batch_circuits (int max_gates) {
+    mask = word_mask (ninputs);
+    tabulate_inputs ();
+    printf ("Trying 0 gates...\n");
+    if (new_db)
+        for (uint64_t t = 0; t < db_nentries (ninputs); ++t)
+            db_entry (new_db, ninputs, t)->gates = db_unsolved | max_gates;
+    for (int value = 0; value <= 1; ++value) {
+        Word constant = value ? mask : word_zero ();
+        if (ts_retire (&targets, constant)) {
+            if (new_db)
+                db_entry (new_db, ninputs, word_low64 (constant))->gates = 0;
+            print_table (constant);
+            printf ("%c = %d\n", vname (ninputs), value);
+        }
+    }
+    for (int w = 0; w < ninputs; ++w)
+        if (ts_retire (&targets, wires[w])) {
+            if (new_db)
+                db_entry (new_db, ninputs, word_low64 (wires[w]))->gates = 0;
+            print_table (wires[w]);
+            printf ("%c = %c\n", vname (ninputs), vname (w));
+        }
+    for (int ngates = 1; ngates <= max_gates && ts_npending (&targets) != 0; ++ngates) {
+        printf ("Trying %d gates...\n", ngates);
+        nwires = ninputs + ngates;
+        assert (nwires <= 26); // vnames must be letters
+        sweeping (ninputs);
+    }
+    ts_each_pending (&targets, ninputs, print_unsolved);
 }
 
 static unsigned parse_uint (const char *s, unsigned base) {
@@ -109,21 +821,242 @@ static unsigned parse_uint (const char *s, unsigned base) {
     return (unsigned) u;
 }
 
-static void superopt (const char *tt_output, int max_gates) {
-    ninputs = (int) log2 (strlen (tt_output));
-    if (1u << ninputs != strlen (tt_output))
+static int table_inputs (const char *tt_output) {
+    int n = (int) log2 (strlen (tt_output));
+    if (1u << n != strlen (tt_output))
         error ("truth_table_output must have a power-of-2 size");
-    if (max_inputs < ninputs)
+    if (max_inputs < n)
         error ("Truth table too big. I can't represent so many inputs.");
-    target_output = parse_uint (tt_output, 2);
-    find_circuits (max_gates);
+    return n;
 }
 
+static Word parse_table (const char *tt_output) {
+    Word table;
+    if (!word_parse (tt_output, &table))
+        error ("truth_table_output must be all 0s and 1s");
+    return table;
+}
+
+// Parse the comma-separated tables in list into 'outputs', dropping
+// repeats.
+static void parse_outputs (const char *list) {
+    char tt[(1 << max_inputs) + 1];
+    for (const char *p = list; ; ++p) {
+        size_t n = strcspn (p, ",");
+        if (sizeof tt <= n)
+            error ("Truth table too big. I can't represent so many inputs.");
+        memcpy (tt, p, n);
+        tt[n] = '\0';
+        int n_inputs = table_inputs (tt);
+        if (noutputs == 0)
+            ninputs = n_inputs;
+        else if (n_inputs != ninputs)
+            error ("The outputs' truth tables must all be the same size");
+        Word table = parse_table (tt);
+        int i = 0;
+        while (i < noutputs && !word_eq (outputs[i], table))
+            ++i;
+        if (i == noutputs) {
+            if (noutputs == max_outputs)
+                error ("Too many outputs");
+            outputs[noutputs++] = table;
+        }
+        p += n;
+        if (*p == '\0')
+            break;
+    }
+}
+
+static void superopt (const char *tt_output, int max_gates) {
+    if (strchr (tt_output, ',')) {
+        if (canon || db || minimize == minimize_depth || stochastic_seconds)
+            error ("--canon, --db, --minimize depth and --stochastic take a single output");
+        parse_outputs (tt_output);
+        find_shared_circuits (max_gates);
+    } else {
+        ninputs = table_inputs (tt_output);
+        if (!word_parse_care (tt_output, &target_output, &care))
+            error ("truth_table_output must be all 0s, 1s and xs");
+        if (stochastic_seconds)
+            find_stochastic_circuits (max_gates);
+        else
+            find_circuits (max_gates);
+    }
+    flush_out ();
+    if (solutions == solutions_count && found)
+        printf ("%llu circuits of %d gates\n", nsolutions, nwires - ninputs);
+}
+
+// Replace the tables by their canonical forms, remembering in
+// 'members' which were which. The constants and inputs are left alone.
+static void canonicalize_targets (Word *tables, size_t ntables) {
+    mask = word_mask (ninputs);
+    tabulate_inputs ();
+    init_canon ();
+    members = malloc (ntables * sizeof *members);
+    if (!members)
+        error ("Out of memory");
+    nmembers = ntables;
+    for (size_t i = 0; i < ntables; ++i) {
+        Npn_member *m = &members[i];
+        m->original = tables[i];
+        m->canonical = npn_canon (&npn, tables[i], &m->transform);
+        if (trivial (m->canonical)) {
+            m->canonical = tables[i];
+            npn_identity (&m->transform, ninputs);
+        }
+        tables[i] = m->canonical;
+    }
+    npn_free (&npn);
+    npn_sort_members (members, nmembers);
+}
+
+// Read whitespace-separated truth tables, all of one size, from
+// filename ("-" for stdin) into 'targets'.
+static void read_targets (const char *filename) {
+    FILE *f = strcmp (filename, "-") == 0 ? stdin : fopen (filename, "r");
+    if (!f)
+        error (strerror (errno));
+    Word *tables = NULL;
+    size_t ntables = 0, room = 0;
+    char tt[(1 << max_inputs) + 2];
+    char format[16];
+    snprintf (format, sizeof format, "%%%zus", sizeof tt - 1);
+    ninputs = -1;
+    while (fscanf (f, format, tt) == 1) {
+        if (strlen (tt) == sizeof tt - 1)
+            error ("Truth table too big. I can't represent so many inputs.");
+        int n = table_inputs (tt);
+        if (ninputs < 0)
+            ninputs = n;
+        else if (n != ninputs)
+            error ("Batch truth tables must all be the same size");
+        if (ntables == room) {
+            room = room ? 2*room : 256;
+            tables = realloc (tables, room * sizeof *tables);
+            if (!tables)
+                error ("Out of memory");
+        }
+        tables[ntables++] = parse_table (tt);
+    }
+    if (f != stdin)
+        fclose (f);
+    if (ninputs < 0)
+        error ("No truth tables to batch");
+    if (!ts_init (&targets, ninputs, ntables))
+        error ("Out of memory");
+    if (canon)
+        canonicalize_targets (tables, ntables);
+    for (size_t i = 0; i < ntables; ++i)
+        ts_add (&targets, tables[i]);
+    free (tables);
+}
+
+// Search every function of db_min_inputs..db_max_inputs inputs up to
+// max_gates, and write the circuits found to filename.
+static void build_db (const char *filename, int max_gates) {
+    if (db_max_gates < max_gates)
+        error ("The database can't hold circuits that big");
+    new_db = calloc (db_size (), 1);
+    if (!new_db)
+        error ("Out of memory");
+    db_init (new_db);
+    batch = 1;
+    for (ninputs = db_min_inputs; ninputs <= db_max_inputs; ++ninputs) {
+        if (!ts_init (&targets, ninputs, db_nentries (ninputs)))
+            error ("Out of memory");
+        for (uint64_t t = 0; t < db_nentries (ninputs); ++t)
+            ts_add (&targets, word_from_low64 (t));
+        find_batch_circuits (max_gates);
+        ts_free (&targets);
+    }
+    FILE *f = fopen (filename, "wb");
+    if (!f || fwrite (new_db, db_size (), 1, f) != 1 || fclose (f) != 0)
+        error (strerror (errno));
+    free (new_db);
+    new_db = NULL;
+}
+
+static const char usage[] =
+    "Usage: circuitoptimizer [--first|--count|--all] [--canon p|npn] [--db FILE]\n"
+    "           [--stats] truth_table_output max_gates\n"
+    "       (truth_table_output may have x for don't-care, or be several\n"
+    "       tables, comma-separated, to share one circuit)\n"
+    "       circuitoptimizer --minimize depth [--first|--count|--all] [--canon p]\n"
+    "           [--stats] truth_table_output max_gates\n"
+    "       circuitoptimizer --stochastic SECONDS [--threads N] truth_table_output max_gates\n"
+    "       circuitoptimizer [--canon p|npn] --batch FILE max_gates\n"
+    "       circuitoptimizer --build-db FILE max_gates";
+
 int main (int argc, char **argv) {
     argv0 = argv[0];
-    assert ((1ULL << (1ULL << max_inputs)) - 1ULL <= UINT_MAX);
-    if (argc != 3)
-        error ("Usage: circuitoptimizer truth_table_output max_gates");
-    superopt (argv[1], (int) parse_uint (argv[2], 10));
+    assert (1u << max_inputs <= CHAR_BIT * sizeof (Word));
+    const char *batch_file = NULL, *build_file = NULL;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        if (strcmp (argv[i], "--batch") == 0 && i+1 < argc)
+            batch_file = argv[++i];
+        else if (strcmp (argv[i], "--build-db") == 0 && i+1 < argc)
+            build_file = argv[++i];
+        else if (strcmp (argv[i], "--db") == 0 && i+1 < argc) {
+            if (!(db = db_open (argv[++i])))
+                error ("Can't open that circuit database");
+        } else if (strcmp (argv[i], "--canon") == 0 && i+1 < argc) {
+            ++i;
+            if (strcmp (argv[i], "p") == 0)
+                canon = canon_p;
+            else if (strcmp (argv[i], "npn") == 0)
+                canon = canon_npn;
+            else
+                error ("--canon takes p or npn");
+        } else if (strcmp (argv[i], "--stochastic") == 0 && i+1 < argc) {
+            stochastic_seconds = atof (argv[++i]);
+            if (!(0 < stochastic_seconds))
+                error ("--stochastic takes a time in seconds");
+        } else if (strcmp (argv[i], "--threads") == 0 && i+1 < argc) {
+            nthreads = (int) parse_uint (argv[++i], 10);
+            if (nthreads < 1 || max_threads < nthreads)
+                error ("Bad thread count");
+        } else if (strcmp (argv[i], "--minimize") == 0 && i+1 < argc) {
+            ++i;
+            if (strcmp (argv[i], "gates") == 0)
+                minimize = minimize_gates;
+            else if (strcmp (argv[i], "depth") == 0)
+                minimize = minimize_depth;
+            else
+                error ("--minimize takes gates or depth");
+        } else if (strcmp (argv[i], "--first") == 0)
+            solutions = solutions_first;
+        else if (strcmp (argv[i], "--count") == 0)
+            solutions = solutions_count;
+        else if (strcmp (argv[i], "--all") == 0)
+            solutions = solutions_all;
+        else if (strcmp (argv[i], "--stats") == 0)
+            stats = 1;
+        else
+            error (usage);
+    }
+    if (argc - i != (batch_file || build_file ? 1 : 2)
+        || ((solutions != solutions_all || stats)
+            && (batch_file || build_file || stochastic_seconds))
+        || (batch_file && (build_file || db))
+        || (build_file && (db || canon))
+        || (minimize == minimize_depth
+            && (batch_file || build_file || db || canon == canon_npn))
+        || (stochastic_seconds
+            && (batch_file || build_file || db || canon || minimize == minimize_depth))
+        || (nthreads != 1 && !stochastic_seconds))
+        error (usage);
+    int max_gates = (int) parse_uint (argv[argc-1], 10);
+    if (batch_file) {
+        batch = 1;
+        read_targets (batch_file);
+        find_batch_circuits (max_gates);
+        ts_free (&targets);
+        free (members);
+    } else if (build_file)
+        build_db (build_file, max_gates);
+    else
+        superopt (argv[i], max_gates);
     return 0;
 }
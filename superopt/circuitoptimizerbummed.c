@@ -1,17 +1,34 @@
-// gcc -std=c99 -W -Wall -g2 -O2 circuitoptimizerbummed.c -o circuitoptimizerbummed
+// gcc -std=c99 -W -Wall -g2 -O2 -pthread circuitoptimizerbummed.c -o circuitoptimizerbummed -lm
+// (add -DCOUNTERS for the --report counters)
+
+#define _POSIX_C_SOURCE 200809L
+#ifdef COUNTERS
+#define _DEFAULT_SOURCE         // for syscall() in counters.h
+#endif
 
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "circuitdb.h"
+#include "counters.h"
+#include "lastgate.h"
+#include "lowerbound.h"
+#include "npn.h"
+#include "targetset.h"
+#include "transtable.h"
+#include "word.h"
+
 enum { max_wires = 20 };
-enum { max_inputs = 5 };
+enum { max_threads = 256 };
 
-typedef unsigned Word;
+// A set of wires, one bit per wire number.
+typedef unsigned Wireset;
 
 static const char *argv0 = "";
 
@@ -21,41 +38,245 @@ static void error (const char *plaint) {
 }
 
 static Word target_output;
+static Word care;               // the rows of target_output that aren't x
+static Word target_zeros;       // the rows where target_output is 0
 
 static int ninputs;
 static Word mask;
 
 static int found = 0;           // boolean
 static int nwires;
-static Word wires[max_wires];
-static int linputs[max_wires];
-static int rinputs[max_wires];
+static int nthreads = 1;
+
+static int batch = 0;           // boolean: solve for every table in 'targets'
+static Target_set targets;
+
+static const unsigned char *db = NULL;     // to look up targets in
+
+static Trans_table table;       // with --table; entries NULL if off
+enum { table_min_remaining = 2 };           // smaller subtrees aren't worth a probe
+static int stats = 0;           // boolean: print node counts per level
+static int report_json = 0;     // boolean: with -DCOUNTERS, report in JSON
+static int mitm = 0;            // boolean: finish the last two gates by lookup
+static Lb_groups groups;        // for the lower bound, with --bounds
+static unsigned long long level_nodes, level_skipped, level_bounded;
+
+// With --canon, search for the canonical form of each target instead,
+// and print the circuit found rewritten by the target's transform.
+enum { canon_none, canon_p, canon_npn };
+static int canon = canon_none;
+static Npn_table npn;
+static Npn target_transform;
+static const Npn *transform = NULL;         // for print_gates()
+static Npn_member *members = NULL;          // the batch, by canonical form
+static size_t nmembers = 0;
+
+// A prefix of the circuit handed to a worker thread: the inputs of
+// the first gates up to split_w, and the sweeping() arguments at
+// that point.
+typedef struct {
+    signed char linputs[2], rinputs[2];
+    Wireset used;
+    int used_size;
+} Task;
+
+// The state of one search. Each worker thread owns one.
+typedef struct {
+    Word wires[wires_padded] __attribute__ ((aligned (wires_align)));
+    int linputs[max_wires];
+    int rinputs[max_wires];
+    // gates_used[w] = a bitset of all gate wires transitively used if
+    //   you use gate w
+    Wireset gates_used[max_wires];
+    // lb_sets[w] = wires[0..w) projected onto each of the groups
+    Lb_set lb_sets[max_wires+1][lb_max_groups];
+    int found;                  // boolean
+    unsigned long long nodes, skipped, bounded;
+#ifdef COUNTERS
+    Counters counters[max_wires];
+#endif
+    // When split_w is reached, the prefix is queued instead of expanded.
+    int split_w;
+    Task *tasks;
+    int ntasks;
+} Search;
 
-// gates_used[w] = a bitset of all gate wires transitively used if you
-//   use gate w
-static Word gates_used[max_wires];  
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Add a finished search's counters to the level's.
+#ifdef COUNTERS
+#define tally(s) counters_add ((s)->counters, ninputs)
+#else
+#define tally(s) ((void) 0)
+#endif
 
 static char vname (int w) {
     return (w < ninputs ? 'A' : 'a') + w;
 }
 
-static void print_circuit (void) {
-    for (int w = ninputs; w < nwires; ++w)
+static void print_wires (int n, const int *ls, const int *rs) {
+    for (int w = ninputs; w < n; ++w)
         printf ("%s%c = ~(%c %c)",
                 w == ninputs ? "" : "; ",
-                vname (w), vname (linputs[w]), vname (rinputs[w]));
+                vname (w), vname (ls[w]), vname (rs[w]));
     printf("\n");
 }
 
+static void print_transformed (const Search *s, const Npn *t) {
+    int ls[max_wires + npn_max_inputs + 1], rs[max_wires + npn_max_inputs + 1];
+    print_wires (npn_map_circuit (t, ninputs, nwires, s->linputs, s->rinputs,
+                                  ls, rs),
+                 ls, rs);
+}
+
+static void print_gates (const Search *s) {
+    if (transform)
+        print_transformed (s, transform);
+    else
+        print_wires (nwires, s->linputs, s->rinputs);
+}
+
+static void print_circuit (const Search *s) {
+    pthread_mutex_lock (&print_lock);
+    print_gates (s);
+    pthread_mutex_unlock (&print_lock);
+}
+
+static void print_bits (Word table) {
+    for (int k = (1 << ninputs) - 1; 0 <= k; --k)
+        putchar ('0' + word_bit (table, k));
+}
+
+static void print_table (Word table) {
+    print_bits (table);
+    printf (": ");
+}
+
+// Print the batch targets searched for as table, each with the
+// circuit in s or, if s is NULL, "not found".
+static void print_targets (Word table, const Search *s) {
+    const Npn_member *m = members ? npn_class (members, nmembers, table) : NULL;
+    if (!m) {
+        print_table (table);
+        if (s)
+            print_gates (s);
+        else
+            printf ("not found\n");
+        return;
+    }
+    for (; m < members + nmembers && word_eq (m->canonical, table); ++m) {
+        if (m != members && word_eq (m[-1].original, m->original))
+            continue;
+        print_table (m->original);
+        if (s)
+            print_transformed (s, &m->transform);
+        else
+            printf ("not found\n");
+    }
+}
+
 static Word compute (Word left_input, Word right_input) {
-    return ~(left_input & right_input);
+    return word_nand (left_input, right_input);
+}
+
+static void note_found (Search *s, int rr) {
+    s->found = 1;
+    s->rinputs[nwires-1] = rr;
+    print_circuit (s);
+}
+
+static void note_batch_found (Search *s, int rr, Word output) {
+    pthread_mutex_lock (&print_lock);
+    if (ts_retire (&targets, output)) {
+        s->found = 1;
+        s->rinputs[nwires-1] = rr;
+        print_targets (output, s);
+    }
+    pthread_mutex_unlock (&print_lock);
+}
+
+static void add_task (Search *s, Wireset used, int used_size) {
+    Task *t = &s->tasks[s->ntasks++];
+    for (int k = ninputs; k < s->split_w; ++k) {
+        t->linputs[k - ninputs] = (signed char) s->linputs[k];
+        t->rinputs[k - ninputs] = (signed char) s->rinputs[k];
+    }
+    t->used = used;
+    t->used_size = used_size;
 }
 
-static void note_found (Word llwire, int rr) {
-    if (llwire < wires[rr]) return;
-    found = 1;
-    rinputs[nwires-1] = rr;
-    print_circuit ();
+// Is the partial circuit up to gate w the same set of gate values as
+// one already expanded? Which of them are used yet counts too, since
+// the search only completes circuits that use every gate.
+static int repeated (Search *s, int w, Wireset all_used) {
+    int remaining = nwires - (w+1);
+    if (!table.entries || remaining < table_min_remaining)
+        return 0;
+    uint64_t key = 0;
+    for (int k = ninputs; k <= w; ++k)
+        key += tt_gate_hash (s->wires[k], 1 & (all_used >> k));
+    if (!tt_seen (&table, key, remaining))
+        return 0;
+    ++s->skipped;
+    COUNT (s->counters[w], cuts[cut_table]);
+    return 1;
+}
+
+// The wires the last gate could pair with the one before it: a NAND
+// is 0 only where both its inputs are 1, so both must be 1 on every
+// row where the target is 0.
+static Wireset compatible_wires (const Word *wires, int n) {
+    Wireset compatible = 0;
+    for (int rr = 0; rr < n; ++rr)
+        if (word_eq (word_and (wires[rr], target_zeros), target_zeros))
+            compatible |= 1u << rr;
+    return compatible;
+}
+
+// With --mitm, finish a circuit whose next-to-last gate w is g without
+// calling sweeping() for the last gate: g must itself be compatible,
+// and then only the compatible wires, and g, are tried against it.
+static void finish (Search *s, int w, Word g, Wireset compatible) {
+    if (!word_eq (word_and (g, target_zeros), target_zeros))
+        return;
+    s->linputs[w+1] = w;
+    compatible |= 1u << w;
+    COUNT_N (s->counters[w+1], final_tests, __builtin_popcount (compatible));
+    for (; compatible != 0; compatible &= compatible - 1) {
+        int rr = __builtin_ctz (compatible);
+        if (word_eq (word_and (care, compute (g, s->wires[rr])), target_output))
+            note_found (s, rr);
+    }
+}
+
+// With --mitm and three gates to go, can gate w still be used? If it
+// isn't compatible, the last gate can't take it, so the next-to-last
+// must: that needs a partner b (maybe itself) leaving the NAND 1 on
+// every row where the target is 0.
+static int dead_end (Search *s, int w) {
+    if (!mitm || w+3 != nwires)
+        return 0;
+    Word g_zeros = word_and (s->wires[w], target_zeros);
+    if (word_eq (g_zeros, target_zeros))
+        return 0;
+    for (int b = 0; b <= w; ++b)
+        if (word_eq (word_and (g_zeros, s->wires[b]), word_zero ()))
+            return 0;
+    COUNT (s->counters[w], cuts[cut_dead_end]);
+    return 1;
+}
+
+// With --bounds, can the gates left after gate w not reach the target
+// even in the projections?
+static int too_far (Search *s, int w) {
+    if (!lb_table)
+        return 0;
+    lb_add (&groups, s->lb_sets[w], s->lb_sets[w+1], s->wires[w]);
+    if (lb_bound (&groups, s->lb_sets[w+1]) <= nwires - (w+1))
+        return 0;
+    ++s->bounded;
+    COUNT (s->counters[w], cuts[cut_bound]);
+    return 1;
 }
 
 // Given the partial circuit before wire #w, with bitset prev_used
@@ -63,41 +284,46 @@ static void note_found (Word llwire, int rr) {
 // and given prev_used_size as the number of bits set in prev_used:
 // Check all extensions of that partial circuit to nwires (pruned
 // for symmetry and optimality).
-static void sweeping (int w, Word prev_used, int prev_used_size) {
+static void sweeping (Search *s, int w, Wireset prev_used, int prev_used_size) {
+    Word *wires = s->wires;
+    Wireset *gates_used = s->gates_used;
+    ++s->nodes;
+    COUNT (s->counters[w], nodes);
+    if (batch && ts_npending (&targets) == 0)
+        return;
+    int finishing = mitm && w+2 == nwires;
+    Wireset compatible = finishing ? compatible_wires (wires, w) : 0;
     for (int ll = 0; ll < w; ++ll) {
         Word llwire = wires[ll];
-        linputs[w] = ll;
+        s->linputs[w] = ll;
 
         if (w+1 < nwires) {
             int l_used_size = prev_used_size;
             if (ninputs <= ll)
                 l_used_size += 1 & ((~prev_used) >> ll);
 
-            // Since NAND is symmetric, we can require the right wire's 
+            // Since NAND is symmetric, we can require the right wire's
             // number to be <= the left one's.
             for (int rr = 0; rr <= ll; ++rr) {
                 Word rrwire = wires[rr];
 
-                // To produce fewer equivalent circuits, we enforce an
-                // ordering on the *truth functions* of the inputs too.
-                if (llwire < rrwire)
-                    goto skip;
-
                 // Require the count of inputs still unassigned to be
                 // enough to use all of the still-unused gate outputs.
-                Word used = gates_used[ll] | gates_used[rr];
-                Word all_used = prev_used | used;
+                Wireset used = gates_used[ll] | gates_used[rr];
+                Wireset all_used = prev_used | used;
                 int all_used_size = l_used_size;
                 if (ninputs <= rr && ll != rr)
                     all_used_size += 1 & ((~prev_used) >> rr);
                 // The ridiculously opaque expression below is
                 // equivalent to, but faster than, the more obvious
-                //   Word n_internal_gates = ngates - 1;
-                //   Word n_unused = n_internal_gates - popcount (all_used);
-                //   Word n_still_unassigned = 2 * (nwires - w - 1);
+                //   int n_internal_gates = ngates - 1;
+                //   int n_unused = n_internal_gates - popcount (all_used);
+                //   int n_still_unassigned = 2 * (nwires - w - 1);
                 //   if (n_still_unassigned < n_unused)
-                if (all_used_size < 2*w)
+                if (all_used_size < 2*w) {
+                    COUNT (s->counters[w], cuts[cut_budget]);
                     goto skip;
+                }
 
                 Word w_wire = compute (llwire, rrwire);
 
@@ -110,72 +336,345 @@ static void sweeping (int w, Word prev_used, int prev_used_size) {
                 for (k = w-1; ninputs <= k; --k) {
                     if (used & (1 << k))
                         break;
-                    if (w_wire <= wires[k])
+                    if (!word_lt (wires[k], w_wire)) {
+                        COUNT (s->counters[w], cuts[cut_commute]);
                         goto skip;
+                    }
                 }
                 for (; 0 <= k; --k) {
-                    if (wires[k] == w_wire)
+                    if (word_eq (wires[k], w_wire)) {
+                        COUNT (s->counters[w], cuts[cut_duplicate]);
                         goto skip;
+                    }
                 }
 
-                // OK! This gate's not pruned.
-                // XXX The above pruning logic is pretty hairy. Test that it works.
-                // XXX What I'm least sure of is the llwire<rrwire condition -- I'm
-                // XXX not sure with the other conditions it's not an overconstraint.
+                // OK! This gate's not pruned. (bench --verify checks
+                // that the pruning still finds every minimal count.)
                 gates_used[w] = used | (1 << w);
                 wires[w] = w_wire;
-                rinputs[w] = rr;
-                sweeping (w + 1, all_used, all_used_size);
+                s->rinputs[w] = rr;
+                if (w+1 == s->split_w)
+                    add_task (s, all_used, all_used_size);
+                else if (finishing)
+                    finish (s, w, w_wire, compatible);
+                else if (!dead_end (s, w) && !too_far (s, w)
+                         && !repeated (s, w, all_used))
+                    sweeping (s, w + 1, all_used, all_used_size);
             skip: ;
             }
-        } else if (ll == w-1) {
+        } else if ((ll == w-1 || w == ninputs) && batch) {
+            // The last gate's left input is the gate before it, or
+            // any input when it's the only gate.
+            COUNT_N (s->counters[w], final_tests, ll+1);
             for (int rr = 0; rr <= ll; ++rr) {
-                if ((mask & compute (llwire, wires[rr])) == target_output)
-                    note_found (llwire, rr);
+                Word output = word_and (mask, compute (llwire, wires[rr]));
+                if (ts_is_pending (&targets, output))
+                    note_batch_found (s, rr, output);
             }
+        } else if (ll == w-1 || w == ninputs) {
+            COUNT_N (s->counters[w], final_tests, ll+1);
+            unsigned hits = last_gate_hits (llwire, wires, ll+1,
+                                            care, target_output);
+            for (; hits != 0; hits &= hits - 1)
+                note_found (s, __builtin_ctz (hits));
         } else {
             // The last gate must use the next-to-last gate's
             // output. The left input here being from another gate
             // forces our choice of the right input.
             int rr = w-1;
-            if (rr <= ll && (mask & compute (llwire, wires[rr])) == target_output)
-                note_found (llwire, rr);
+            if (rr <= ll)
+                COUNT (s->counters[w], final_tests);
+            if (rr <= ll && word_eq (word_and (care, compute (llwire, wires[rr])),
+                                     target_output))
+                note_found (s, rr);
         }
     }
 }
 
-static void tabulate_inputs (void) {
-    for (int i = 1; i <= ninputs; ++i) {
-        Word shift = 1 << (i-1);
-        wires[ninputs-i] = (1u << shift) - 1;
-        for (int j = ninputs-i+1; j < ninputs; ++j)
-            wires[j] |= wires[j] << shift;
+// Input w is 1 in the rows whose index has bit ninputs-1-w clear.
+static void tabulate_inputs (Word *wires) {
+    for (int w = 0; w < ninputs; ++w) {
+        wires[w] = word_zero ();
+        for (int k = 0; k < 1 << ninputs; ++k)
+            if (!(1 & (k >> (ninputs-1 - w))))
+                wires[w] = word_set_bit (wires[w], k);
     }
 }
 
-static void find_circuits (int max_gates) {
-    mask = (1u << (1u << ninputs)) - 1u;
-    tabulate_inputs ();
-    printf ("Trying 0 gates...\n");
-    if (target_output == 0 || target_output == mask) {
-        printf ("%c = %d\n", vname (ninputs), target_output & 1);
+static void init_search (Search *s) {
+    memset (s, 0, sizeof *s);
+    tabulate_inputs (s->wires);
+    if (lb_table)
+        for (int w = 0; w < ninputs; ++w)
+            lb_add (&groups, s->lb_sets[w], s->lb_sets[w+1], s->wires[w]);
+}
+
+
+// Parallel search. The first gates' (ll, rr) choices that survive
+// pruning become tasks. Each worker starts with a contiguous run of
+// them and, once that's used up, steals half of some other worker's
+// remaining run. All workers finish the level before we look at
+// 'found'.
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int next, end;              // our remaining tasks are tasks[next..end)
+    Search search;
+} Worker;
+
+static Worker workers[max_threads];
+static Task *tasks;
+static int split_w;
+
+static int take_task (Worker *self) {
+    int t = -1;
+    pthread_mutex_lock (&self->lock);
+    if (self->next < self->end)
+        t = self->next++;
+    pthread_mutex_unlock (&self->lock);
+    return t;
+}
+
+static int steal_tasks (Worker *self) {
+    int me = (int) (self - workers);
+    for (int i = 1; i < nthreads; ++i) {
+        Worker *victim = &workers[(me + i) % nthreads];
+        pthread_mutex_lock (&victim->lock);
+        int left = victim->end - victim->next;
+        int end = victim->end;
+        if (1 < left)
+            victim->end -= left / 2;
+        pthread_mutex_unlock (&victim->lock);
+        if (1 < left) {
+            pthread_mutex_lock (&self->lock);
+            self->next = end - left / 2;
+            self->end = end;
+            pthread_mutex_unlock (&self->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_task (Search *s, const Task *t) {
+    for (int k = ninputs; k < split_w; ++k) {
+        int ll = t->linputs[k - ninputs], rr = t->rinputs[k - ninputs];
+        s->linputs[k] = ll;
+        s->rinputs[k] = rr;
+        s->wires[k] = compute (s->wires[ll], s->wires[rr]);
+        s->gates_used[k] = s->gates_used[ll] | s->gates_used[rr] | (1 << k);
+        if (lb_table)
+            lb_add (&groups, s->lb_sets[k], s->lb_sets[k+1], s->wires[k]);
+    }
+    sweeping (s, split_w, t->used, t->used_size);
+}
+
+static void *work (void *arg) {
+    Worker *self = arg;
+    for (;;) {
+        int t = take_task (self);
+        if (t < 0) {
+            if (!steal_tasks (self))
+                return NULL;
+            continue;
+        }
+        run_task (&self->search, &tasks[t]);
+    }
+}
+
+static void parallel_sweeping (void) {
+    // Enough tasks to keep every worker busy, but with the split no
+    // deeper than the last-but-one gate.
+    split_w = ninputs + (nwires - ninputs - 1 < 2 ? nwires - ninputs - 1 : 2);
+    Search *s = &workers[0].search;
+    init_search (s);
+    if (split_w == ninputs) {
+        sweeping (s, ninputs, 0, ninputs + nwires - 1);
+        found |= s->found;
+        level_nodes += s->nodes;
+        level_skipped += s->skipped;
+        level_bounded += s->bounded;
+        tally (s);
         return;
     }
+
+    size_t max_tasks = 1;
+    for (int k = ninputs; k < split_w; ++k)
+        max_tasks *= (size_t) k * (k+1) / 2;
+    tasks = malloc (max_tasks * sizeof *tasks);
+    if (!tasks)
+        error ("Out of memory");
+    s->split_w = split_w;
+    s->tasks = tasks;
+    sweeping (s, ninputs, 0, ninputs + nwires - 1);
+    int ntasks = s->ntasks;
+    level_nodes += s->nodes;
+    tally (s);
+
+    for (int i = 0; i < nthreads; ++i) {
+        Worker *wk = &workers[i];
+        init_search (&wk->search);
+        wk->next = (int) ((long) ntasks * i / nthreads);
+        wk->end  = (int) ((long) ntasks * (i+1) / nthreads);
+        pthread_mutex_init (&wk->lock, NULL);
+        if (pthread_create (&wk->thread, NULL, work, wk))
+            error ("Can't create thread");
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_join (workers[i].thread, NULL);
+        pthread_mutex_destroy (&workers[i].lock);
+        found |= workers[i].search.found;
+        level_nodes += workers[i].search.nodes;
+        level_skipped += workers[i].search.skipped;
+        level_bounded += workers[i].search.bounded;
+        tally (&workers[i].search);
+    }
+    free (tasks);
+    tasks = NULL;
+}
+
+
+static void sweep_level (int ngates) {
+    static Search search;
+    printf ("Trying %d gates...\n", ngates);
+    fflush (stdout);
+    nwires = ninputs + ngates;
+    assert (nwires <= 26); // vnames must be letters
+    // The table's entries all have fewer gates remaining than any
+    // partial circuit of this level, so they'd never be hit.
+    if (table.entries)
+        tt_clear (&table);
+    level_nodes = level_skipped = level_bounded = 0;
+    target_zeros = word_and (care, word_nand (target_output, target_output));
+    if (lb_table)
+        lb_init_groups (&groups, ninputs, target_output, care);
+#ifdef COUNTERS
+    counters_begin_level (ngates);
+#endif
+    if (1 < nthreads)
+        parallel_sweeping ();
+    else {
+        init_search (&search);
+        sweeping (&search, ninputs, 0, ninputs + nwires - 1);
+        found = search.found;
+        level_nodes = search.nodes;
+        level_skipped = search.skipped;
+        level_bounded = search.bounded;
+        tally (&search);
+    }
+#ifdef COUNTERS
+    counters_end_level ();
+#endif
+    if (stats)
+        printf ("%d gates: %llu partial circuits, %llu skipped by the table,"
+                " %llu cut by the bound\n",
+                ngates, level_nodes, level_skipped, level_bounded);
+}
+
+// Is table a constant or one of the inputs, needing no gates?
+static int trivial (Word table, const Word *inputs) {
+    if (word_eq (table, word_zero ()) || word_eq (table, mask))
+        return 1;
     for (int w = 0; w < ninputs; ++w)
-        if (target_output == wires[w]) {
+        if (word_eq (table, inputs[w]))
+            return 1;
+    return 0;
+}
+
+static void init_canon (const Word *inputs) {
+    if (npn_max_inputs < ninputs)
+        error ("--canon handles at most 6 inputs");
+    if (!npn_init (&npn, ninputs, canon == canon_npn, inputs))
+        error ("Out of memory");
+}
+
+// Does table agree with the target wherever it cares?
+static int matches (Word table) {
+    return word_eq (word_and (care, table), target_output);
+}
+
+static void find_circuits (int max_gates) {
+    mask = word_mask (ninputs);
+    Word inputs[max_inputs];
+    tabulate_inputs (inputs);
+    pick_last_gate_kernel ();
+    printf ("Trying 0 gates...\n");
+    for (int value = 0; value <= 1; ++value)
+        if (matches (value ? mask : word_zero ())) {
+            printf ("%c = %d\n", vname (ninputs), value);
+            return;
+        }
+    for (int w = 0; w < ninputs; ++w)
+        if (matches (inputs[w])) {
             printf ("%c = %c\n", vname (ninputs), vname (w));
             return;
         }
-    memset (gates_used, 0, sizeof gates_used);
-    for (int ngates = 1; ngates <= max_gates; ++ngates) {
-        printf ("Trying %d gates...\n", ngates);
-        nwires = ninputs + ngates;
-        assert (nwires <= 26); // vnames must be letters
-        if (sweeping (ninputs, 0, ninputs + nwires - 1), found)
+    int partial = !word_eq (care, mask);
+    if (canon && partial)
+        error ("--canon needs a table without don't-cares");
+    if (canon) {
+        init_canon (inputs);
+        Word c = npn_canon (&npn, target_output, &target_transform);
+        npn_free (&npn);
+        if (!trivial (c, inputs)) {
+            target_output = c;
+            transform = &target_transform;
+            printf ("Canonical form ");
+            print_bits (c);
+            printf ("\n");
+        }
+    }
+    int first_gates = 1;
+    if (db && !partial && db_min_inputs <= ninputs && ninputs <= db_max_inputs) {
+        const Db_entry *e = db_entry (db, ninputs, word_low64 (target_output));
+        if (!(e->gates & db_unsolved)) {
+            if (e->gates <= max_gates) {
+                static Search search;
+                printf ("Found %d gates in the database\n", e->gates);
+                nwires = ninputs + e->gates;
+                db_unpack (e, ninputs, search.linputs, search.rinputs);
+                print_circuit (&search);
+            }
+            return;
+        }
+        first_gates = (e->gates & ~db_unsolved) + 1;
+    }
+    for (int ngates = first_gates; ngates <= max_gates; ++ngates) {
+        sweep_level (ngates);
+        if (found)
             return;
     }
 }
 
+static void print_unsolved (Word table) {
+    print_targets (table, NULL);
+}
+
+// Like find_circuits(), for every table in 'targets' at once. Each
+// table is retired with the first circuit found for it.
+static void find_batch_circuits (int max_gates) {
+    mask = word_mask (ninputs);
+    Word inputs[max_inputs];
+    tabulate_inputs (inputs);
+    printf ("Trying 0 gates...\n");
+    for (int value = 0; value <= 1; ++value) {
+        Word constant = value ? mask : word_zero ();
+        if (ts_retire (&targets, constant)) {
+            print_table (constant);
+            printf ("%c = %d\n", vname (ninputs), value);
+        }
+    }
+    for (int w = 0; w < ninputs; ++w)
+        if (ts_retire (&targets, inputs[w])) {
+            print_table (inputs[w]);
+            printf ("%c = %c\n", vname (ninputs), vname (w));
+        }
+    for (int ngates = 1; ngates <= max_gates && ts_npending (&targets) != 0; ++ngates)
+        sweep_level (ngates);
+    ts_each_pending (&targets, ninputs, print_unsolved);
+}
+
 static unsigned parse_uint (const char *s, unsigned base) {
     char *end;
     unsigned long u = strtoul (s, &end, base);
@@ -186,21 +685,170 @@ static unsigned parse_uint (const char *s, unsigned base) {
     return (unsigned) u;
 }
 
-static void superopt (const char *tt_output, int max_gates) {
-    ninputs = (int) log2 (strlen (tt_output));
-    if (1u << ninputs != strlen (tt_output))
+static int table_inputs (const char *tt_output) {
+    int n = (int) log2 (strlen (tt_output));
+    if (1u << n != strlen (tt_output))
         error ("truth_table_output must have a power-of-2 size");
-    if (max_inputs < ninputs)
+    if (max_inputs < n)
         error ("Truth table too big. I can't represent so many inputs.");
-    target_output = parse_uint (tt_output, 2);
+    return n;
+}
+
+static Word parse_table (const char *tt_output) {
+    Word table;
+    if (!word_parse (tt_output, &table))
+        error ("truth_table_output must be all 0s and 1s");
+    return table;
+}
+
+static void superopt (const char *tt_output, int max_gates) {
+    ninputs = table_inputs (tt_output);
+    if (!word_parse_care (tt_output, &target_output, &care))
+        error ("truth_table_output must be all 0s, 1s and xs");
     find_circuits (max_gates);
 }
 
+// Replace the tables by their canonical forms, remembering in
+// 'members' which were which. The constants and inputs are left alone.
+static void canonicalize_targets (Word *tables, size_t ntables) {
+    mask = word_mask (ninputs);
+    Word inputs[max_inputs];
+    tabulate_inputs (inputs);
+    init_canon (inputs);
+    members = malloc (ntables * sizeof *members);
+    if (!members)
+        error ("Out of memory");
+    nmembers = ntables;
+    for (size_t i = 0; i < ntables; ++i) {
+        Npn_member *m = &members[i];
+        m->original = tables[i];
+        m->canonical = npn_canon (&npn, tables[i], &m->transform);
+        if (trivial (m->canonical, inputs)) {
+            m->canonical = tables[i];
+            npn_identity (&m->transform, ninputs);
+        }
+        tables[i] = m->canonical;
+    }
+    npn_free (&npn);
+    npn_sort_members (members, nmembers);
+}
+
+// Read whitespace-separated truth tables, all of one size, from
+// filename ("-" for stdin) into 'targets'.
+static void read_targets (const char *filename) {
+    FILE *f = strcmp (filename, "-") == 0 ? stdin : fopen (filename, "r");
+    if (!f)
+        error (strerror (errno));
+    Word *tables = NULL;
+    size_t ntables = 0, room = 0;
+    char tt[(1 << max_inputs) + 2];
+    char format[16];
+    snprintf (format, sizeof format, "%%%zus", sizeof tt - 1);
+    ninputs = -1;
+    while (fscanf (f, format, tt) == 1) {
+        if (strlen (tt) == sizeof tt - 1)
+            error ("Truth table too big. I can't represent so many inputs.");
+        int n = table_inputs (tt);
+        if (ninputs < 0)
+            ninputs = n;
+        else if (n != ninputs)
+            error ("Batch truth tables must all be the same size");
+        if (ntables == room) {
+            room = room ? 2*room : 256;
+            tables = realloc (tables, room * sizeof *tables);
+            if (!tables)
+                error ("Out of memory");
+        }
+        tables[ntables++] = parse_table (tt);
+    }
+    if (f != stdin)
+        fclose (f);
+    if (ninputs < 0)
+        error ("No truth tables to batch");
+    if (!ts_init (&targets, ninputs, ntables))
+        error ("Out of memory");
+    if (canon)
+        canonicalize_targets (tables, ntables);
+    for (size_t i = 0; i < ntables; ++i)
+        ts_add (&targets, tables[i]);
+    free (tables);
+}
+
+static const char usage[] =
+    "Usage: circuitoptimizerbummed [options] [--db FILE] truth_table_output max_gates\n"
+    "       (truth_table_output may have x for don't-care)\n"
+    "       circuitoptimizerbummed [options] --batch FILE max_gates\n"
+    "Options: --threads N, --canon p|npn, --table MB, --mitm, --bounds FILE, --stats,\n"
+    "         --report table|json (built with -DCOUNTERS)";
+
 int main (int argc, char **argv) {
     argv0 = argv[0];
-    assert ((1ULL << (1ULL << max_inputs)) - 1ULL <= UINT_MAX);
-    if (argc != 3)
-        error ("Usage: circuitoptimizer truth_table_output max_gates");
-    superopt (argv[1], (int) parse_uint (argv[2], 10));
+    assert (1u << max_inputs <= CHAR_BIT * sizeof (Word));
+    const char *batch_file = NULL;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        if (strcmp (argv[i], "--threads") == 0 && i+1 < argc) {
+            nthreads = (int) parse_uint (argv[++i], 10);
+            if (nthreads < 1 || max_threads < nthreads)
+                error ("--threads must be between 1 and 256");
+        } else if (strcmp (argv[i], "--batch") == 0 && i+1 < argc)
+            batch_file = argv[++i];
+        else if (strcmp (argv[i], "--db") == 0 && i+1 < argc) {
+            if (!(db = db_open (argv[++i])))
+                error ("Can't open that circuit database");
+        } else if (strcmp (argv[i], "--table") == 0 && i+1 < argc) {
+            size_t mb = parse_uint (argv[++i], 10);
+            if (mb && !tt_init (&table, mb << 20))
+                error ("Can't allocate a table that big");
+        } else if (strcmp (argv[i], "--stats") == 0)
+            stats = 1;
+        else if (strcmp (argv[i], "--mitm") == 0)
+            mitm = 1;
+        else if (strcmp (argv[i], "--report") == 0 && i+1 < argc) {
+#ifndef COUNTERS
+            error ("--report needs a build with -DCOUNTERS");
+#endif
+            ++i;
+            if (strcmp (argv[i], "table") == 0)
+                report_json = 0;
+            else if (strcmp (argv[i], "json") == 0)
+                report_json = 1;
+            else
+                error ("--report takes table or json");
+        }
+        else if (strcmp (argv[i], "--bounds") == 0 && i+1 < argc) {
+            if (!lb_open (argv[++i]))
+                error ("Can't open or build that bounds table");
+        } else if (strcmp (argv[i], "--canon") == 0 && i+1 < argc) {
+            ++i;
+            if (strcmp (argv[i], "p") == 0)
+                canon = canon_p;
+            else if (strcmp (argv[i], "npn") == 0)
+                canon = canon_npn;
+            else
+                error ("--canon takes p or npn");
+        } else
+            error (usage);
+    }
+    if (batch_file) {
+        if (argc - i != 1)
+            error (usage);
+        if (mitm || lb_table)
+            error ("--mitm and --bounds work on one target at a time");
+        batch = 1;
+        read_targets (batch_file);
+        find_batch_circuits ((int) parse_uint (argv[i], 10));
+        ts_free (&targets);
+        free (members);
+    } else {
+        if (argc - i != 2)
+            error (usage);
+        superopt (argv[i], (int) parse_uint (argv[i+1], 10));
+    }
+    tt_free (&table);
+#ifdef COUNTERS
+    fflush (stdout);
+    counters_report (stderr, report_json);
+#endif
     return 0;
 }
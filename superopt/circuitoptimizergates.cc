@@ -0,0 +1,310 @@
+// g++ -std=c++17 -W -Wall -g2 -O2 circuitoptimizergates.cc -o circuitoptimizergates
+
+// circuitoptimizer.c's exhaustive sweep over a library of gates fixed
+// at compile time, instead of NAND alone. A library is a list of gate
+// types; Library::each() unrolls into one loop nest per gate type, so
+// each inner loop is still a single inlined bitwise op. A gate's
+// arity, cost and commutativity are traits of its type: the rr <= ll
+// pruning applies only to commutative gates.
+//
+// Circuits are searched by total cost rather than gate count: level c
+// tries every circuit costing exactly c whose last gate is the output.
+// With unit costs that's the gate count, and the NAND library
+// searches just what circuitoptimizer.c does, in the same order. Only
+// multiples of the gcd of the gate costs are tried, since no circuit
+// can cost anything else: the cell library's costs are all even.
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+#include "word.h"
+
+#ifdef WORD_VECTOR
+#error "circuitoptimizergates.cc needs a scalar Word (MAX_INPUTS <= 6)"
+#endif
+
+enum { max_wires = 20 };
+
+// Gate types. apply() computes the gate on every row at once.
+
+struct Nand {
+    static constexpr int arity = 2, cost = 1;
+    static constexpr bool commutative = true;
+    static constexpr const char *name = "~";
+    static Word apply (Word a, Word b) { return ~(a & b); }
+};
+
+struct And {
+    static constexpr int arity = 2, cost = 1;
+    static constexpr bool commutative = true;
+    static constexpr const char *name = "and";
+    static Word apply (Word a, Word b) { return a & b; }
+};
+
+struct Or {
+    static constexpr int arity = 2, cost = 1;
+    static constexpr bool commutative = true;
+    static constexpr const char *name = "or";
+    static Word apply (Word a, Word b) { return a | b; }
+};
+
+struct Xor {
+    static constexpr int arity = 2, cost = 1;
+    static constexpr bool commutative = true;
+    static constexpr const char *name = "xor";
+    static Word apply (Word a, Word b) { return a ^ b; }
+};
+
+struct Not {
+    static constexpr int arity = 1, cost = 1;
+    static constexpr bool commutative = true;
+    static constexpr const char *name = "not";
+    static Word apply (Word a) { return ~a; }
+};
+
+struct Majority {
+    static constexpr int arity = 3, cost = 1;
+    static constexpr bool commutative = true;
+    static constexpr const char *name = "maj";
+    static Word apply (Word a, Word b, Word c) {
+        return (a & b) | (a & c) | (b & c);
+    }
+};
+
+// Any 2-input function: bit (a<<1 | b) of table is its output for
+// inputs a and b. The ifs are on constants and fold away.
+template <unsigned table, int cost_>
+struct Table2 {
+    static constexpr int arity = 2, cost = cost_;
+    static constexpr bool commutative = (1 & (table >> 1)) == (1 & (table >> 2));
+    static Word apply (Word a, Word b) {
+        Word out = 0;
+        if (table & 1) out |= ~a & ~b;
+        if (table & 2) out |= ~a & b;
+        if (table & 4) out |= a & ~b;
+        if (table & 8) out |= a & b;
+        return out;
+    }
+};
+
+// A standard-cell library, costed in transistors.
+struct Inv : Not {
+    static constexpr int cost = 2;
+    static constexpr const char *name = "inv";
+};
+struct Nand2 : Table2<0x7, 4> { static constexpr const char *name = "nand2"; };
+struct Nor2  : Table2<0x1, 4> { static constexpr const char *name = "nor2"; };
+struct And2  : Table2<0x8, 6> { static constexpr const char *name = "and2"; };
+struct Or2   : Table2<0xE, 6> { static constexpr const char *name = "or2"; };
+struct Xor2  : Table2<0x6, 8> { static constexpr const char *name = "xor2"; };
+struct Xnor2 : Table2<0x9, 8> { static constexpr const char *name = "xnor2"; };
+
+template <class... Gates>
+struct Library {
+    static constexpr bool zero = false;     // is a constant 0 wire free?
+    // Call f (Gate ()) for each gate type, in order.
+    template <class F>
+    static void each (F f) { (f (Gates ()), ...); }
+    // Every circuit's cost is a multiple of this.
+    static constexpr int cost_step () {
+        int g = 0;
+        ((g = std::gcd (g, Gates::cost)), ...);
+        return g;
+    }
+};
+
+using Nand_library     = Library<Nand>;
+using Aoxn_library     = Library<And, Or, Xor, Not>;
+// Majority and NOT make only self-dual functions of the inputs; a
+// free constant 0 gives them AND and OR, as in majority-inverter graphs.
+struct Majority_library : Library<Majority, Not> {
+    static constexpr bool zero = true;
+};
+using Cell_library     = Library<Inv, Nand2, Nor2, And2, Or2, Xor2, Xnor2>;
+
+static const char *argv0 = "";
+
+static void error (const char *plaint) {
+    fprintf (stderr, "%s: %s\n", argv0, plaint);
+    exit (1);
+}
+
+static Word target_output;
+
+static int ninputs;
+static int nfixed;              // the inputs, then maybe a constant 0
+static Word mask;
+
+static char vname (int w) {
+    return w < ninputs ? 'A' + w : w < nfixed ? '0' : 'a' + w;
+}
+
+// Input w is 1 in the rows whose index has bit ninputs-1-w clear.
+static void tabulate_inputs (Word *wires) {
+    for (int w = 0; w < ninputs; ++w) {
+        wires[w] = 0;
+        for (int k = 0; k < 1 << ninputs; ++k)
+            if (!(1 & (k >> (ninputs-1 - w))))
+                wires[w] |= (Word) 1 << k;
+    }
+}
+
+template <class Lib>
+struct Search {
+    Word wires[max_wires];
+    const char *names[max_wires];
+    int arities[max_wires];
+    int inputs[max_wires][3];
+    int budget;                 // the cost of the circuits this level
+    bool found = false;
+
+    void print_circuit (int nwires) {
+        for (int w = nfixed; w < nwires; ++w) {
+            printf ("%s%c = %s(", w == nfixed ? "" : "; ", vname (w), names[w]);
+            for (int i = 0; i < arities[w]; ++i)
+                printf ("%s%c", i == 0 ? "" : " ", vname (inputs[w][i]));
+            printf (")");
+        }
+        printf ("\n");
+    }
+
+    // Call visit (out) for each way to wire gate w as a G, with its
+    // inputs in inputs[w]. Commutative gates take them in order.
+    template <class G, class F>
+    void each_wiring (int w, F visit) {
+        int *in = inputs[w];
+        if constexpr (G::arity == 1) {
+            for (int a = 0; a < w; ++a) {
+                in[0] = a;
+                visit (G::apply (wires[a]));
+            }
+        } else if constexpr (G::arity == 2) {
+            for (int ll = 0; ll < w; ++ll) {
+                Word llwire = wires[ll];
+                in[0] = ll;
+                for (int rr = 0; rr < (G::commutative ? ll+1 : w); ++rr) {
+                    in[1] = rr;
+                    visit (G::apply (llwire, wires[rr]));
+                }
+            }
+        } else {
+            static_assert (G::arity == 3, "gates take 1 to 3 inputs");
+            for (int a = 0; a < w; ++a) {
+                in[0] = a;
+                for (int b = 0; b < (G::commutative ? a+1 : w); ++b) {
+                    in[1] = b;
+                    Word ab = wires[b];
+                    for (int c = 0; c < (G::commutative ? b+1 : w); ++c) {
+                        in[2] = c;
+                        visit (G::apply (wires[a], ab, wires[c]));
+                    }
+                }
+            }
+        }
+    }
+
+    // Place gate w with 'spent' of the budget spent on the gates before
+    // it. A gate that spends the rest must be the output.
+    void sweeping (int w, int spent) {
+        Lib::each ([&] (auto gate) {
+            using G = decltype (gate);
+            int now = spent + G::cost;
+            if (budget < now)
+                return;
+            names[w] = G::name;
+            arities[w] = G::arity;
+            if (now == budget)
+                this->template each_wiring<G> (w, [&] (Word out) {
+                    if ((mask & out) == target_output) {
+                        found = true;
+                        print_circuit (w + 1);
+                    }
+                });
+            else if (w+1 < max_wires)
+                this->template each_wiring<G> (w, [&] (Word out) {
+                    wires[w] = out;
+                    sweeping (w + 1, now);
+                });
+        });
+    }
+};
+
+template <class Lib>
+static void find_circuits (int max_cost) {
+    static Search<Lib> s;
+    mask = word_mask (ninputs);
+    tabulate_inputs (s.wires);
+    nfixed = ninputs;
+    if (Lib::zero)
+        s.wires[nfixed++] = 0;
+    printf ("Trying cost 0...\n");
+    if (target_output == 0 || target_output == mask) {
+        printf ("%c = %d\n", vname (nfixed), (int) (target_output & 1));
+        return;
+    }
+    for (int w = 0; w < ninputs; ++w)
+        if (target_output == s.wires[w]) {
+            printf ("%c = %c\n", vname (nfixed), vname (w));
+            return;
+        }
+    constexpr int step = Lib::cost_step ();
+    for (int cost = step; cost <= max_cost; cost += step) {
+        printf ("Trying cost %d...\n", cost);
+        fflush (stdout);
+        s.budget = cost;
+        s.sweeping (nfixed, 0);
+        if (s.found)
+            return;
+    }
+}
+
+static unsigned parse_uint (const char *s, unsigned base) {
+    char *end;
+    unsigned long u = strtoul (s, &end, base);
+    if (u == 0 && errno == EINVAL)
+        error (strerror (errno));
+    if (*end != '\0')
+        error ("Literal has crud in it, or extra spaces, or something");
+    return (unsigned) u;
+}
+
+static void superopt (const char *library, const char *tt_output, int max_cost) {
+    ninputs = (int) log2 (strlen (tt_output));
+    if (1u << ninputs != strlen (tt_output))
+        error ("truth_table_output must have a power-of-2 size");
+    if (max_inputs < ninputs)
+        error ("Truth table too big. I can't represent so many inputs.");
+    if (!word_parse (tt_output, &target_output))
+        error ("truth_table_output must be all 0s and 1s");
+    if (strcmp (library, "nand") == 0)
+        find_circuits<Nand_library> (max_cost);
+    else if (strcmp (library, "aoxn") == 0)
+        find_circuits<Aoxn_library> (max_cost);
+    else if (strcmp (library, "majority") == 0)
+        find_circuits<Majority_library> (max_cost);
+    else if (strcmp (library, "cells") == 0)
+        find_circuits<Cell_library> (max_cost);
+    else
+        error ("--library must be nand, aoxn, majority or cells");
+}
+
+static const char usage[] =
+    "Usage: circuitoptimizergates [--library nand|aoxn|majority|cells] truth_table_output max_cost";
+
+int main (int argc, char **argv) {
+    argv0 = argv[0];
+    const char *library = "nand";
+    int i = 1;
+    if (i+1 < argc && strcmp (argv[i], "--library") == 0) {
+        library = argv[i+1];
+        i += 2;
+    }
+    if (argc - i != 2)
+        error (usage);
+    superopt (library, argv[i], (int) parse_uint (argv[i+1], 10));
+    return 0;
+}
@@ -1,17 +1,20 @@
 // gcc -std=c99 -W -Wall -g2 -O2 circuitoptimizerloopy.c -o circuitoptimizerloopy
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
-enum { max_wires = 20 };
-enum { max_inputs = 5 };
+#include "word.h"
 
-typedef unsigned Word;
+enum { max_wires = 20 };
 
 static const char *argv0 = "";
 
@@ -20,17 +23,36 @@ static void error (const char *plaint) {
     exit (1);
 }
 
+static const char *target_table; // target_output as written
 static Word target_output;
 
 static int ninputs;
 static Word mask;
 
 static int found = 0;           // boolean
+static int stats = 0;           // boolean: print node counts per level
+// The partial circuits (gate prefixes) this run entered, as
+// circuitoptimizer.c's sweeping() would count its calls.
+static unsigned long long level_nodes;
 static int nwires;
 static Word wires[max_wires];
 static int linputs[max_wires];
 static int rinputs[max_wires];
 
+// The odometer's digits, most significant first, are the (linputs,
+// rinputs) pairs of gates ninputs..nwires-2, then linputs[nwires-1]
+// (the last gate's rinput is swept inside the loop). A shard is the
+// contiguous run of odometer states whose first shard_depth digits,
+// read as a mixed-radix number, lie in [shard_start, shard_end).
+static int shard_index = 0, shard_count = 1;
+static int shard_depth;
+static long shard_start, shard_end;
+
+static const char *checkpoint_file = NULL;
+static unsigned checkpoint_interval = 60; // seconds
+static volatile sig_atomic_t checkpoint_due = 0;
+static int resuming = 0;        // boolean: odometer was loaded from a file
+
 static char vname (int w) {
     return (w < ninputs ? 'A' : 'a') + w;
 }
@@ -44,16 +66,126 @@ static void print_circuit (void) {
 }
 
 static Word compute (Word left_input, Word right_input) {
-    return ~(left_input & right_input);
+    return word_nand (left_input, right_input);
 }
 
-static void sweeping (void) {
+static long digit_radix (int w) {
+    return w+1 < nwires ? (long) w * (w+1) / 2 : w;
+}
+
+static long prefix_index (void) {
+    long index = 0;
+    for (int w = ninputs; w < ninputs + shard_depth; ++w) {
+        long digit = w+1 < nwires
+            ? (long) linputs[w] * (linputs[w]+1) / 2 + rinputs[w]
+            : linputs[w];
+        index = index * digit_radix (w) + digit;
+    }
+    return index;
+}
+
+static void set_prefix (long index) {
     for (int k = 0; k < nwires; ++k)
         linputs[k] = rinputs[k] = 0;
+    for (int w = ninputs + shard_depth - 1; ninputs <= w; --w) {
+        long digit = index % digit_radix (w);
+        index /= digit_radix (w);
+        if (w+1 < nwires) {
+            int ll = 0;
+            while ((long) (ll+1) * (ll+2) / 2 <= digit)
+                ++ll;
+            linputs[w] = ll;
+            rinputs[w] = (int) (digit - (long) ll * (ll+1) / 2);
+        } else
+            linputs[w] = (int) digit;
+    }
+}
+
+// Pick enough leading digits that the shards can be of roughly even
+// size, and this shard's slice of them.
+static void plan_shard (void) {
+    long nprefixes = 1;
+    shard_depth = 0;
+    if (1 < shard_count)
+        while (shard_depth < nwires - ninputs
+               && nprefixes < 64L * shard_count)
+            nprefixes *= digit_radix (ninputs + shard_depth++);
+    shard_start = nprefixes * shard_index / shard_count;
+    shard_end   = nprefixes * (shard_index+1) / shard_count;
+}
+
+static void save_checkpoint (int done) {
+    char tmp[4096];
+    if (sizeof tmp <= (size_t) snprintf (tmp, sizeof tmp, "%s.tmp", checkpoint_file))
+        error ("Checkpoint filename too long");
+    FILE *f = fopen (tmp, "w");
+    if (!f)
+        error (strerror (errno));
+    fprintf (f, "circuitoptimizerloopy checkpoint\n");
+    fprintf (f, "target %s ninputs %d shard %d/%d\n",
+             target_table, ninputs, shard_index, shard_count);
+    fprintf (f, "nwires %d found %d done %d\n", nwires, found, done);
+    for (int w = ninputs; w < nwires; ++w)
+        fprintf (f, "%d %d\n", linputs[w], w+1 < nwires ? rinputs[w] : 0);
+    if (fclose (f) != 0 || rename (tmp, checkpoint_file) != 0)
+        error (strerror (errno));
+}
+
+// Returns the gate count to continue at, or 0 if the checkpointed
+// search had already finished.
+static int load_checkpoint (const char *filename) {
+    FILE *f = fopen (filename, "r");
+    if (!f)
+        error (strerror (errno));
+    char target[257];
+    int n, index, count, done;
+    if (fscanf (f, "circuitoptimizerloopy checkpoint target %256[01] ninputs %d shard %d/%d",
+                target, &n, &index, &count) != 4)
+        error ("Bad checkpoint file");
+    if (strcmp (target, target_table) != 0 || n != ninputs
+        || index != shard_index || count != shard_count)
+        error ("Checkpoint is for a different target or shard");
+    if (fscanf (f, " nwires %d found %d done %d", &nwires, &found, &done) != 3
+        || nwires <= ninputs || max_wires < nwires)
+        error ("Bad checkpoint file");
+    for (int k = 0; k < nwires; ++k)
+        linputs[k] = rinputs[k] = 0;
+    for (int w = ninputs; w < nwires; ++w)
+        if (fscanf (f, "%d %d", &linputs[w], &rinputs[w]) != 2
+            || linputs[w] < 0 || w <= linputs[w]
+            || rinputs[w] < 0 || linputs[w] < rinputs[w])
+            error ("Bad checkpoint file");
+    fclose (f);
+    if (done)
+        return 0;
+    resuming = 1;
+    return nwires - ninputs;
+}
+
+static void on_alarm (int sig) {
+    (void) sig;
+    checkpoint_due = 1;
+    alarm (checkpoint_interval);
+}
+
+static void sweeping (void) {
+    plan_shard ();
+    if (resuming)
+        resuming = 0;
+    else
+        set_prefix (shard_start);
+    if (shard_end <= shard_start)
+        return;
     int w = ninputs;
+    ++level_nodes;              // the empty prefix
     for (;;) {
+        if (checkpoint_due) {
+            checkpoint_due = 0;
+            save_checkpoint (0);
+        }
 
         // Update the circuit representation for the current 'number':
+        level_nodes += nwires-1 - w;
         for (int k = w; k < nwires-1; ++k)
             wires[k] = compute (wires[linputs[k]], wires[rinputs[k]]);
         int last_rinput = 0;
@@ -62,10 +194,11 @@ static void sweeping (void) {
         
         // Test the circuit and bump the 'last digit' until 'carry':
         do {
-            if (target_output == (mask & compute (last_wire_linput,
-                                                  wires[last_rinput]))) {
+            if (word_eq (target_output,
+                         word_and (mask, compute (last_wire_linput,
+                                                  wires[last_rinput])))) {
                 found = 1;
-                rinputs[w] = last_rinput;
+                rinputs[nwires-1] = last_rinput;
                 print_circuit ();
             }
         } while (++last_rinput <= last_linput);
@@ -80,36 +213,54 @@ static void sweeping (void) {
                 break;
             rinputs[w] = 0;
         }
+        if (w < ninputs + shard_depth && prefix_index () == shard_end)
+            return;             // End of this shard
     }
 }
 
+// Input w is 1 in the rows whose index has bit ninputs-1-w clear.
 static void tabulate_inputs (void) {
-    for (int i = 1; i <= ninputs; ++i) {
-        Word shift = 1 << (i-1);
-        wires[ninputs-i] = (1u << shift) - 1;
-        for (int j = ninputs-i+1; j < ninputs; ++j)
-            wires[j] |= wires[j] << shift;
+    for (int w = 0; w < ninputs; ++w) {
+        wires[w] = word_zero ();
+        for (int k = 0; k < 1 << ninputs; ++k)
+            if (!(1 & (k >> (ninputs-1 - w))))
+                wires[w] = word_set_bit (wires[w], k);
     }
 }
 
-static void find_circuits (int max_gates) {
-    mask = (1u << (1u << ninputs)) - 1u;
+static void find_circuits (int first_gates, int max_gates) {
+    mask = word_mask (ninputs);
     tabulate_inputs ();
     printf ("Trying 0 gates...\n");
-    if (target_output == 0 || target_output == mask) {
-        printf ("%c = %d\n", vname (ninputs), target_output & 1);
+    if (word_eq (target_output, word_zero ()) || word_eq (target_output, mask)) {
+        printf ("%c = %d\n", vname (ninputs), word_bit (target_output, 0));
         return;
     }
     for (int w = 0; w < ninputs; ++w)
-        if (target_output == wires[w]) {
+        if (word_eq (target_output, wires[w])) {
             printf ("%c = %c\n", vname (ninputs), vname (w));
             return;
         }
-    for (int ngates = 1; ngates <= max_gates; ++ngates) {
+    for (int ngates = first_gates; ngates <= max_gates; ++ngates) {
         printf ("Trying %d gates...\n", ngates);
+        fflush (stdout);
         nwires = ninputs + ngates;
         assert (nwires <= 26); // vnames must be letters
-        if (sweeping (), found)
+        level_nodes = 0;
+        sweeping ();
+        if (stats)
+            printf ("%d gates: %llu partial circuits\n", ngates, level_nodes);
+        if (checkpoint_file) {
+            // Record the start of the next level, or that we're done.
+            int done = found || ngates == max_gates;
+            if (!done) {
+                ++nwires;
+                plan_shard ();
+                set_prefix (shard_start);
+            }
+            save_checkpoint (done);
+        }
+        if (found)
             return;
     }
 }
@@ -124,21 +275,66 @@ static unsigned parse_uint (const char *s, unsigned base) {
     return (unsigned) u;
 }
 
-static void superopt (const char *tt_output, int max_gates) {
+static void superopt (const char *tt_output, int max_gates,
+                      const char *resume_file) {
     ninputs = (int) log2 (strlen (tt_output));
     if (1u << ninputs != strlen (tt_output))
         error ("truth_table_output must have a power-of-2 size");
     if (max_inputs < ninputs)
         error ("Truth table too big. I can't represent so many inputs.");
-    target_output = parse_uint (tt_output, 2);
-    find_circuits (max_gates);
+    target_table = tt_output;
+    if (!word_parse (tt_output, &target_output))
+        error ("truth_table_output must be all 0s and 1s");
+    int first_gates = 1;
+    if (resume_file && !(first_gates = load_checkpoint (resume_file))) {
+        printf ("Checkpointed search already finished.\n");
+        return;
+    }
+    if (checkpoint_file) {
+        struct sigaction sa;
+        memset (&sa, 0, sizeof sa);
+        sa.sa_handler = on_alarm;
+        sa.sa_flags = SA_RESTART;
+        sigaction (SIGALRM, &sa, NULL);
+        alarm (checkpoint_interval);
+    }
+    find_circuits (first_gates, max_gates);
 }
 
+// With --shard i/N, run N processes with i = 0..N-1 and take the
+// smallest gate count any of them found.
+static const char usage[] =
+    "Usage: circuitoptimizerloopy [--checkpoint FILE [--interval SECONDS]]\n"
+    "         [--resume FILE] [--shard i/N] [--stats] truth_table_output max_gates";
+
 int main (int argc, char **argv) {
     argv0 = argv[0];
-    assert ((1ULL << (1ULL << max_inputs)) - 1ULL <= UINT_MAX);
-    if (argc != 3)
-        error ("Usage: circuitoptimizer truth_table_output max_gates");
-    superopt (argv[1], (int) parse_uint (argv[2], 10));
+    assert (1u << max_inputs <= CHAR_BIT * sizeof (Word));
+    const char *resume_file = NULL;
+    int i = 1;
+    for (; i+1 < argc && argv[i][0] == '-' && argv[i][1] == '-'; i += 2) {
+        const char *opt = argv[i], *val = argv[i+1];
+        if (strcmp (opt, "--stats") == 0) {
+            stats = 1;
+            --i;                // it takes no value
+        } else if (strcmp (opt, "--checkpoint") == 0)
+            checkpoint_file = val;
+        else if (strcmp (opt, "--interval") == 0) {
+            checkpoint_interval = parse_uint (val, 10);
+            if (checkpoint_interval == 0)
+                error ("--interval must be positive");
+        } else if (strcmp (opt, "--resume") == 0)
+            resume_file = val;
+        else if (strcmp (opt, "--shard") == 0) {
+            if (sscanf (val, "%d/%d", &shard_index, &shard_count) != 2
+                || shard_count < 1 || shard_index < 0
+                || shard_count <= shard_index)
+                error ("--shard wants i/N with 0 <= i < N");
+        } else
+            error (usage);
+    }
+    if (argc - i != 2)
+        error (usage);
+    superopt (argv[i], (int) parse_uint (argv[i+1], 10), resume_file);
     return 0;
 }
@@ -0,0 +1,214 @@
+// Counters for what the search does at each gate, compiled in with
+// -DCOUNTERS. Without it COUNT() and COUNT_N() expand to nothing and
+// there's no Counters type, so the search runs exactly as before.
+//
+// A Search keeps one Counters per wire number. Each gate-count level
+// adds up its searches' counters into a Counters_level, along with
+// its wall time and, where perf_event_open works, the cycles and
+// instructions spent on it (threads included). counters_report()
+// prints the levels as a table or as JSON.
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+// The rules that cut a gate: too few inputs left to use every gate,
+// out of order with a commuting gate, repeating a wire, unusable with
+// three gates to go (--mitm), beyond the lower bound (--bounds), or
+// seen in the table (--table).
+enum { cut_budget, cut_commute, cut_duplicate, cut_dead_end,
+       cut_bound, cut_table, ncuts };
+
+#ifdef COUNTERS
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char *const cut_names[ncuts] = {
+    "budget", "commute", "duplicate", "dead_end", "bound", "table"
+};
+
+typedef struct {
+    unsigned long long nodes;   // calls to sweeping()
+    unsigned long long cuts[ncuts];
+    unsigned long long final_tests;     // last gates evaluated
+} Counters;
+
+#define COUNT(c, field) (++(c).field)
+#define COUNT_N(c, field, n) ((c).field += (unsigned long long) (n))
+
+enum { counters_max_gates = 32, counters_max_levels = 32 };
+
+typedef struct {
+    int ngates;
+    double seconds;
+    long long cycles, instructions;     // -1 if unavailable
+    Counters gates[counters_max_gates]; // by gate number, from 0
+} Counters_level;
+
+static Counters_level counters_levels[counters_max_levels];
+static int counters_nlevels = 0;
+static Counters_level *counters_level = NULL;   // the one running
+static int counters_fds[2] = { -2, -2 };        // -2 until opened
+static double counters_start;
+static long long counters_base[2];
+
+static inline double counters_now (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static inline int counters_perf_open (unsigned long long config) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset (&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;           // count the worker threads too
+    return (int) syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void) config;
+    return -1;
+#endif
+}
+
+static inline long long counters_perf_read (int fd) {
+    long long value;
+    if (fd < 0 || read (fd, &value, sizeof value) != sizeof value)
+        return -1;
+    return value;
+}
+
+static inline void counters_begin_level (int ngates) {
+    if (counters_fds[0] == -2) {
+#ifdef __linux__
+        counters_fds[0] = counters_perf_open (PERF_COUNT_HW_CPU_CYCLES);
+        counters_fds[1] = counters_perf_open (PERF_COUNT_HW_INSTRUCTIONS);
+#else
+        counters_fds[0] = counters_fds[1] = -1;
+#endif
+    }
+    if (counters_nlevels == counters_max_levels) {
+        counters_level = NULL;
+        return;
+    }
+    counters_level = &counters_levels[counters_nlevels++];
+    memset (counters_level, 0, sizeof *counters_level);
+    counters_level->ngates = ngates;
+    for (int i = 0; i < 2; ++i)
+        counters_base[i] = counters_perf_read (counters_fds[i]);
+    counters_start = counters_now ();
+}
+
+// Add the counters of one search, for wires first..first+ngates, to
+// the running level.
+static inline void counters_add (const Counters *c, int first) {
+    if (!counters_level)
+        return;
+    int n = counters_level->ngates;
+    if (counters_max_gates < n)
+        n = counters_max_gates;
+    for (int g = 0; g < n; ++g) {
+        Counters *to = &counters_level->gates[g];
+        const Counters *from = &c[first + g];
+        to->nodes += from->nodes;
+        for (int i = 0; i < ncuts; ++i)
+            to->cuts[i] += from->cuts[i];
+        to->final_tests += from->final_tests;
+    }
+}
+
+static inline void counters_end_level (void) {
+    Counters_level *l = counters_level;
+    if (!l)
+        return;
+    l->seconds = counters_now () - counters_start;
+    long long end[2];
+    for (int i = 0; i < 2; ++i)
+        end[i] = counters_perf_read (counters_fds[i]);
+    l->cycles = end[0] < 0 || counters_base[0] < 0 ? -1 : end[0] - counters_base[0];
+    l->instructions = end[1] < 0 || counters_base[1] < 0 ? -1 : end[1] - counters_base[1];
+    counters_level = NULL;
+}
+
+static inline void counters_print_count (FILE *f, long long n, int json) {
+    if (n < 0)
+        fprintf (f, json ? "null" : "%12s", "-");
+    else
+        fprintf (f, json ? "%lld" : "%12lld", n);
+}
+
+static inline void counters_report (FILE *f, int json) {
+    if (json)
+        fprintf (f, "{\"levels\": [");
+    for (int i = 0; i < counters_nlevels; ++i) {
+        const Counters_level *l = &counters_levels[i];
+        int n = l->ngates < counters_max_gates ? l->ngates : counters_max_gates;
+        if (json) {
+            fprintf (f, "%s\n  {\"gates\": %d, \"seconds\": %.6f, \"cycles\": ",
+                     i == 0 ? "" : ",", l->ngates, l->seconds);
+            counters_print_count (f, l->cycles, 1);
+            fprintf (f, ", \"instructions\": ");
+            counters_print_count (f, l->instructions, 1);
+            fprintf (f, ",\n   \"by_gate\": [");
+            for (int g = 0; g < n; ++g) {
+                const Counters *c = &l->gates[g];
+                fprintf (f, "%s\n    {\"gate\": %d, \"nodes\": %llu",
+                         g == 0 ? "" : ",", g + 1, c->nodes);
+                for (int k = 0; k < ncuts; ++k)
+                    fprintf (f, ", \"%s\": %llu", cut_names[k], c->cuts[k]);
+                fprintf (f, ", \"final_tests\": %llu}", c->final_tests);
+            }
+            fprintf (f, "]}");
+            continue;
+        }
+        fprintf (f, "%d gates: %.3f s, cycles ", l->ngates, l->seconds);
+        counters_print_count (f, l->cycles, 0);
+        fprintf (f, ", instructions ");
+        counters_print_count (f, l->instructions, 0);
+        fprintf (f, "\n%4s %12s", "gate", "nodes");
+        for (int k = 0; k < ncuts; ++k)
+            fprintf (f, " %12s", cut_names[k]);
+        fprintf (f, " %12s\n", "final_tests");
+        Counters total;
+        memset (&total, 0, sizeof total);
+        for (int g = 0; g <= n; ++g) {
+            const Counters *c = g < n ? &l->gates[g] : &total;
+            if (g < n)
+                fprintf (f, "%4d", g + 1);
+            else
+                fprintf (f, "%4s", "all");
+            fprintf (f, " %12llu", c->nodes);
+            for (int k = 0; k < ncuts; ++k)
+                fprintf (f, " %12llu", c->cuts[k]);
+            fprintf (f, " %12llu\n", c->final_tests);
+            if (g < n) {
+                total.nodes += c->nodes;
+                for (int k = 0; k < ncuts; ++k)
+                    total.cuts[k] += c->cuts[k];
+                total.final_tests += c->final_tests;
+            }
+        }
+    }
+    if (json)
+        fprintf (f, "\n]}\n");
+}
+
+#else
+
+#define COUNT(c, field) ((void) 0)
+#define COUNT_N(c, field, n) ((void) 0)
+
+#endif
+
+#endif
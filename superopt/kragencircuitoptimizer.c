@@ -28,7 +28,6 @@ work, multiple permutations of the same circuit.
  */
 
 #include <assert.h>
-#include <setjmp.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -150,8 +149,8 @@ void reset_circuit(circuit *cp) {
   }
 }
 
-/* go to the lexically next valid circuit and return 1, 
- * or return 0 if that's not possible. */
+/* go to the lexically next valid circuit and return the lowest gate
+ * number it changed, or return 0 if that's not possible. */
 int increment_circuit(circuit *cp) {
   /* in valid circuits, each input[ii][x] < ii, and of course >= 0. */
   /* We also enforce the condition that input[ii][1] <= input[ii][0],
@@ -159,17 +158,19 @@ int increment_circuit(circuit *cp) {
    * doesn't help. */
   int ii;
   int min;
+  int changed;
   for (ii = cp->ninputs + cp->ngates - 1; ii >= cp->ninputs; ii--) {
     min = ii - 1;
     if (cp->input[ii][0] < min) min = cp->input[ii][0];
     if (cp->input[ii][1] != min) {
       cp->input[ii][1]++;
     zero_lower_order_gates:
+      changed = ii;
       for (ii++; ii < cp->ninputs + cp->ngates; ii++) {
         cp->input[ii][0] = 0;
         cp->input[ii][1] = 0;
       }
-      return 1;
+      return changed;
     }
     if (cp->input[ii][0] != ii - 1) {
       cp->input[ii][0]++;
@@ -180,37 +181,50 @@ int increment_circuit(circuit *cp) {
   return 0;
 }
 
-/* it isn't *really* necessary to put this in a struct.  Maybe I've
-   been programming Python too much... */
+/* Circuits are tested bit-sliced: bit r of a 'rows' is row r of a
+ * truth table, in the order enumtable() visits them (and the pattern
+ * lists them), so one NAND of two words evaluates a gate on every row
+ * at once. */
+typedef unsigned long long rows;
+#define MAX_INPUTS 6
+
 typedef struct {
-  int counter;
-  char *pattern;
-  jmp_buf mismatch;
+  rows want;     /* the rows where the pattern has a 1 */
+  rows care;     /* the rows where it has a 0 or a 1, not an x */
+  rows *outputs; /* outputs[ii] = output of gate ii on every row */
 } search_result;
 
-search_result the_search_result;
-
-void match(void *client_data, circuit *cp, int *inputs, int output) {
-  (void) cp;
-  (void) inputs;
-  search_result *sr = client_data;
-  char pattern_element = sr->pattern[sr->counter];
-  sr->counter++;
-  if (pattern_element == 'x') return;  /* don't care */
-  if (output != pattern_element - '0') longjmp(sr->mismatch, -1);
+/* input ii is 1 in row r when bit ninputs-1-ii of r is set, as
+   enumtable() counts */
+void tabulate_inputs(circuit *cp, search_result *sr) {
+  int ii, r;
+  for (ii = 0; ii < cp->ninputs; ii++) {
+    sr->outputs[ii] = 0;
+    for (r = 0; r < 1 << cp->ninputs; r++)
+      if (r >> (cp->ninputs - 1 - ii) & 1) sr->outputs[ii] |= (rows)1 << r;
+  }
 }
 
-int test_circuit(circuit *cp, char *pattern) {
-  search_result *sr = &the_search_result;
-  sr->counter = 0;
-  sr->pattern = pattern;
-
-  if (setjmp(sr->mismatch) == 0) {
-    enumtable(cp, sr, &match);
-  } else {
-    return 0;  /* found a mismatch */
+void parse_pattern(search_result *sr, char *pattern) {
+  int r;
+  sr->want = sr->care = 0;
+  for (r = 0; pattern[r]; r++) {
+    if (pattern[r] == 'x') continue;  /* don't care */
+    sr->care |= (rows)1 << r;
+    if (pattern[r] == '1') sr->want |= (rows)1 << r;
   }
-  return 1;
+}
+
+/* Recompute the cached outputs of the gates from 'changed' on (the
+ * ones increment_circuit() touched), and see if the circuit's output
+ * matches the pattern wherever it cares. */
+int test_circuit(circuit *cp, search_result *sr, int changed) {
+  rows *out = sr->outputs;
+  int ii;
+  int noutputs = cp->ninputs + cp->ngates;
+  for (ii = changed; ii < noutputs; ii++)
+    out[ii] = ~(out[cp->input[ii][0]] & out[cp->input[ii][1]]);
+  return ((out[noutputs - 1] ^ sr->want) & sr->care) == 0;
 }
 
 int inputs_for_pattern(char *pattern) {
@@ -237,14 +251,20 @@ int max_gates_for_inputs(int inputs) {
 
 int main(int argc, char **argv) {
   circuit *cp = 0;
-  int ninputs, ngates, maxgates, done;
-  if (argc != 2) {
+  search_result sr;
+  int ninputs, ngates, maxgates, done, changed;
+  /* with --stats, count the partial circuits (gate prefixes) each
+     level enters, as circuitoptimizer.c's sweeping() counts its calls */
+  int stats = argc == 3 && strcmp(argv[1], "--stats") == 0;
+  unsigned long long nodes;
+  if (argc != 2 + stats) {
     fprintf(stderr, 
-	    "%s: Usage: %s pattern\n"
+	    "%s: Usage: %s [--stats] pattern\n"
 	    "pattern is a pattern of 0's, 1's, and x's.\n", 
 	    argv[0], argv[0]);
     return 1;
   }
+  if (stats) argv[1] = argv[2];
   if (!(ninputs = inputs_for_pattern(argv[1]))) {
     fprintf(stderr,
 	    "%s: Don't understand pattern '%s' of length %lu.\n"
@@ -253,6 +273,13 @@ int main(int argc, char **argv) {
 	    argv[0], argv[1], strlen(argv[1]));
     return 2;
   }
+  if (ninputs > MAX_INPUTS) {
+    fprintf(stderr, "%s: Can't handle more than %d inputs.\n",
+	    argv[0], MAX_INPUTS);
+    return 2;
+  }
+  parse_pattern(&sr, argv[1]);
+  sr.outputs = 0;
   {
     int ii;
     printf("Inputs: ");
@@ -266,21 +293,28 @@ int main(int argc, char **argv) {
     printf("Trying with %d gates...\n", ngates);
     free(cp);
     cp = newcircuit(ninputs, ngates);
-    if (!cp) {  /* out of memory, probably; how likely is that?! */
+    free(sr.outputs);
+    sr.outputs = malloc((ninputs + ngates) * sizeof(rows));
+    if (!cp || !sr.outputs) {  /* out of memory, probably; how likely is that?! */
       fprintf(stderr, "For %d inputs and %d gates", ninputs, ngates);
       perror("newcircuit");
       return 3;
     }
     reset_circuit(cp);
+    tabulate_inputs(cp, &sr);
     printf("\n");
+    changed = ninputs;
+    nodes = ngates != 0;  /* the empty prefix */
     do {
-      if (test_circuit(cp, argv[1])) {
+      if (ngates != 0) nodes += ninputs + ngates - 1 - changed;
+      if (test_circuit(cp, &sr, changed)) {
           //nicely_print_circuit(cp);
           printcircuit(cp);
           //enumtable(cp, 0, &printentry);
 	done = 1;
       }
-    } while (increment_circuit(cp));
+    } while ((changed = increment_circuit(cp)));
+    if (stats) printf("%d gates: %llu partial circuits\n", ngates, nodes);
     if (done) return 0;  /* no need to try more complex circuits... */
   }
   assert(0);  /* should never happen */
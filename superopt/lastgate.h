@@ -0,0 +1,109 @@
+// The final-gate test, vectorized across right inputs: given the last
+// gate's left input llwire, which of wires[0..n) as its right input
+// make the masked NAND equal the target? The answer is a bitset with
+// bit rr set for each hit.
+//
+// last_gate_hits is picked at startup by CPUID: AVX-512 tests 16
+// 32-bit (or 8 64-bit) wires per instruction, AVX2 8 (or 4), and
+// otherwise it's the plain loop. The SIMD kernels load whole vectors,
+// so wires[] must be aligned to wires_align bytes and have
+// wires_padded entries; the lanes past n are ignored.
+
+#ifndef LASTGATE_H
+#define LASTGATE_H
+
+#include "word.h"
+
+enum { wires_padded = 32 };
+#define wires_align 64
+
+typedef unsigned Last_gate_fn (Word llwire, const Word *wires, int n,
+                               Word mask, Word target);
+
+static unsigned last_gate_scalar (Word llwire, const Word *wires, int n,
+                                  Word mask, Word target) {
+    unsigned hits = 0;
+    for (int rr = 0; rr < n; ++rr)
+        if (word_eq (word_and (mask, word_nand (llwire, wires[rr])), target))
+            hits |= 1u << rr;
+    return hits;
+}
+
+#if (defined (__x86_64__) || defined (__i386__)) && !defined (WORD_VECTOR)
+#define LAST_GATE_SIMD 1
+
+#include <immintrin.h>
+
+static unsigned low_bits (int n) {
+    return n < 32 ? (1u << n) - 1 : ~0u;
+}
+
+__attribute__ ((target ("avx2")))
+static unsigned last_gate_avx2 (Word llwire, const Word *wires, int n,
+                                Word mask, Word target) {
+    unsigned hits = 0;
+    if (sizeof (Word) == 4) {
+        __m256i l = _mm256_set1_epi32 ((int) llwire);
+        __m256i m = _mm256_set1_epi32 ((int) mask);
+        __m256i t = _mm256_set1_epi32 ((int) target);
+        for (int rr = 0; rr < n; rr += 8) {
+            __m256i r = _mm256_load_si256 ((const __m256i *) (wires + rr));
+            __m256i out = _mm256_andnot_si256 (_mm256_and_si256 (l, r), m);
+            __m256i eq = _mm256_cmpeq_epi32 (out, t);
+            hits |= (unsigned) _mm256_movemask_ps (_mm256_castsi256_ps (eq)) << rr;
+        }
+    } else {
+        __m256i l = _mm256_set1_epi64x ((long long) llwire);
+        __m256i m = _mm256_set1_epi64x ((long long) mask);
+        __m256i t = _mm256_set1_epi64x ((long long) target);
+        for (int rr = 0; rr < n; rr += 4) {
+            __m256i r = _mm256_load_si256 ((const __m256i *) (wires + rr));
+            __m256i out = _mm256_andnot_si256 (_mm256_and_si256 (l, r), m);
+            __m256i eq = _mm256_cmpeq_epi64 (out, t);
+            hits |= (unsigned) _mm256_movemask_pd (_mm256_castsi256_pd (eq)) << rr;
+        }
+    }
+    return hits & low_bits (n);
+}
+
+__attribute__ ((target ("avx512f")))
+static unsigned last_gate_avx512 (Word llwire, const Word *wires, int n,
+                                  Word mask, Word target) {
+    unsigned hits = 0;
+    if (sizeof (Word) == 4) {
+        __m512i l = _mm512_set1_epi32 ((int) llwire);
+        __m512i m = _mm512_set1_epi32 ((int) mask);
+        __m512i t = _mm512_set1_epi32 ((int) target);
+        for (int rr = 0; rr < n; rr += 16) {
+            __m512i r = _mm512_load_si512 ((const void *) (wires + rr));
+            __m512i out = _mm512_andnot_si512 (_mm512_and_si512 (l, r), m);
+            hits |= (unsigned) _mm512_cmpeq_epi32_mask (out, t) << rr;
+        }
+    } else {
+        __m512i l = _mm512_set1_epi64 ((long long) llwire);
+        __m512i m = _mm512_set1_epi64 ((long long) mask);
+        __m512i t = _mm512_set1_epi64 ((long long) target);
+        for (int rr = 0; rr < n; rr += 8) {
+            __m512i r = _mm512_load_si512 ((const void *) (wires + rr));
+            __m512i out = _mm512_andnot_si512 (_mm512_and_si512 (l, r), m);
+            hits |= (unsigned) _mm512_cmpeq_epi64_mask (out, t) << rr;
+        }
+    }
+    return hits & low_bits (n);
+}
+
+#endif
+
+static Last_gate_fn *last_gate_hits = last_gate_scalar;
+
+static void pick_last_gate_kernel (void) {
+#ifdef LAST_GATE_SIMD
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx512f"))
+        last_gate_hits = last_gate_avx512;
+    else if (__builtin_cpu_supports ("avx2"))
+        last_gate_hits = last_gate_avx2;
+#endif
+}
+
+#endif
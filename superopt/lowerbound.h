@@ -0,0 +1,158 @@
+// Lower bounds on the gates a partial circuit still needs to reach
+// the target, from projections onto a few rows: a circuit that
+// computes the target from some wires also computes the target's
+// restriction to any rows from theirs, with no more gates.
+//
+// On lb_rows = 4 rows a function is one of 16 values, and a set of
+// wires a 16-bit mask of them, so the exact distance from every set
+// to every value fits a 1 MB table: lb_table[set << 4 | value], or
+// lb_unreachable. The table is built once and cached in a file.
+//
+// A group is lb_rows rows of the full table; the bound is the largest
+// over the groups.
+
+#ifndef LOWERBOUND_H
+#define LOWERBOUND_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "word.h"
+
+enum { lb_rows = 4, lb_values = 1 << lb_rows, lb_sets = 1 << lb_values };
+enum { lb_max_groups = 8 };
+enum { lb_unreachable = 255 };
+
+static const char lb_magic[8] = "NANDLB1";
+
+typedef uint16_t Lb_set;        // bit v for each value v present
+
+typedef struct {
+    int ngroups;
+    int rows[lb_max_groups][lb_rows];
+    int target[lb_max_groups];          // the target's value on the rows
+} Lb_groups;
+
+static const unsigned char *lb_table = NULL;
+
+static inline size_t lb_size (void) {
+    return sizeof lb_magic + (size_t) lb_sets * lb_values;
+}
+
+// Fill in the distances. A set's distance to v is 0 if v is in it,
+// else 1 + the least distance from the set plus one new NAND of its
+// members. Those supersets are numerically bigger, so go downward.
+static inline void lb_build (unsigned char *dist) {
+    for (int set = lb_sets - 1; 0 <= set; --set) {
+        unsigned new_values = 0;
+        for (int a = 0; a < lb_values; ++a)
+            if (1 & (set >> a))
+                for (int b = 0; b <= a; ++b)
+                    if (1 & (set >> b))
+                        new_values |= 1u << (~(a & b) & (lb_values - 1));
+        new_values &= ~(unsigned) set;
+        for (int v = 0; v < lb_values; ++v) {
+            int d = lb_unreachable;
+            if (1 & (set >> v))
+                d = 0;
+            else
+                for (unsigned n = new_values; n != 0; n &= n - 1) {
+                    int superset = set | 1 << __builtin_ctz (n);
+                    int e = dist[superset << 4 | v];
+                    if (e != lb_unreachable && e + 1 < d)
+                        d = e + 1;
+                }
+            dist[set << 4 | v] = (unsigned char) d;
+        }
+    }
+}
+
+// Point lb_table at the table cached in filename, building and
+// writing the file first if it isn't there. Returns 0 on failure.
+static inline int lb_open (const char *filename) {
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0) {
+        unsigned char *image = malloc (lb_size ());
+        if (!image)
+            return 0;
+        memcpy (image, lb_magic, sizeof lb_magic);
+        lb_build (image + sizeof lb_magic);
+        FILE *f = fopen (filename, "wb");
+        int ok = f && fwrite (image, lb_size (), 1, f) == 1;
+        if (f && fclose (f) != 0)
+            ok = 0;
+        if (!ok) {
+            free (image);
+            return 0;
+        }
+        lb_table = image + sizeof lb_magic;
+        return 1;
+    }
+    struct stat st;
+    void *image = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && (size_t) st.st_size == lb_size ())
+        image = mmap (NULL, lb_size (), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (image == MAP_FAILED)
+        return 0;
+    if (memcmp (image, lb_magic, sizeof lb_magic) != 0) {
+        munmap (image, lb_size ());
+        return 0;
+    }
+    lb_table = (const unsigned char *) image + sizeof lb_magic;
+    return 1;
+}
+
+// The value of table on a group's rows.
+static inline int lb_project (const Lb_groups *g, int i, Word table) {
+    int v = 0;
+    for (int j = 0; j < lb_rows; ++j)
+        v |= word_bit (table, g->rows[i][j]) << j;
+    return v;
+}
+
+// Split the rows the target cares about into groups, striding so that
+// each group varies the first inputs rather than the last. (Over the
+// 3-input functions that cut a fifth more than runs of consecutive
+// rows.) Rows that are don't-cares can't go in a group: the target
+// has no one value on them.
+static inline void lb_init_groups (Lb_groups *g, int ninputs, Word target,
+                                   Word care) {
+    int care_rows[1 << max_inputs], ncare = 0;
+    for (int k = 0; k < 1 << ninputs; ++k)
+        if (word_bit (care, k))
+            care_rows[ncare++] = k;
+    int stride = ncare / lb_rows;
+    g->ngroups = stride < lb_max_groups ? stride : lb_max_groups;
+    for (int i = 0; i < g->ngroups; ++i) {
+        for (int j = 0; j < lb_rows; ++j)
+            g->rows[i][j] = care_rows[i + j * stride];
+        g->target[i] = lb_project (g, i, target);
+    }
+}
+
+// Add wire to the projected sets.
+static inline void lb_add (const Lb_groups *g, const Lb_set *sets,
+                           Lb_set *result, Word wire) {
+    for (int i = 0; i < g->ngroups; ++i)
+        result[i] = sets[i] | (Lb_set) (1u << lb_project (g, i, wire));
+}
+
+// A lower bound on the gates needed to reach the target from sets.
+static inline int lb_bound (const Lb_groups *g, const Lb_set *sets) {
+    int bound = 0;
+    for (int i = 0; i < g->ngroups; ++i) {
+        int d = lb_table[(size_t) sets[i] << 4 | g->target[i]];
+        if (bound < d)
+            bound = d;
+    }
+    return bound;
+}
+
+#endif
@@ -0,0 +1,199 @@
+// Canonical forms of truth tables under permutation of the inputs
+// (P) or, also, negation of inputs and output (NPN).
+//
+// A transform t says that f(x) = o ^ c(z), where z[w] =
+// x[perm[w]] ^ negate[w] and o = negate_output: it tells how to build
+// the circuit for f out of a circuit for c. The canonical form of f is
+// the least c, by word_lt, over all the transforms.
+//
+// Only the permutations leave the gate count alone. Each input
+// negation costs an inverter in front of the circuit for c, and an
+// output negation one more behind it, so the circuits NPN gives back
+// needn't be minimal for f.
+
+#ifndef NPN_H
+#define NPN_H
+
+#include <stdlib.h>
+
+#include "word.h"
+
+enum { npn_max_inputs = 6 };
+
+typedef struct {
+    signed char perm[npn_max_inputs];
+    unsigned char negate;       // bit w for input w
+    unsigned char negate_output;
+} Npn;
+
+// Every transform for ninputs, with rowmap[i << ninputs | k] the row
+// of f that row k of c is read from.
+typedef struct {
+    int ninputs;
+    int ntransforms;
+    Npn *transforms;
+    unsigned char *rowmaps;
+} Npn_table;
+
+// The row of input values x, by the optimizers' tabulate_inputs().
+static inline int npn_input_row (int ninputs, const int *x) {
+    int k = 0;
+    for (int w = 0; w < ninputs; ++w)
+        k |= !x[w] << (ninputs-1 - w);
+    return k;
+}
+
+static inline void npn_add_permutations (Npn_table *nt, int negations,
+                                  const Word *inputs,
+                                  signed char *perm, int used, int w) {
+    int n = nt->ninputs;
+    if (w < n) {
+        for (int v = 0; v < n; ++v)
+            if (!(1 & (used >> v))) {
+                perm[w] = (signed char) v;
+                npn_add_permutations (nt, negations, inputs,
+                                      perm, used | 1 << v, w+1);
+            }
+        return;
+    }
+    int nneg = negations ? 1 << n : 1;
+    for (int negate = 0; negate < nneg; ++negate)
+        for (int o = 0; o <= negations; ++o) {
+            int i = nt->ntransforms++;
+            Npn *t = &nt->transforms[i];
+            memcpy (t->perm, perm, sizeof t->perm);
+            t->negate = (unsigned char) negate;
+            t->negate_output = (unsigned char) o;
+            // Read z off the input columns, and find the row of x.
+            for (int k = 0; k < 1 << n; ++k) {
+                int x[npn_max_inputs];
+                for (int v = 0; v < n; ++v)
+                    x[perm[v]] = word_bit (inputs[v], k) ^ (1 & (negate >> v));
+                nt->rowmaps[(size_t) i << n | k] =
+                    (unsigned char) npn_input_row (n, x);
+            }
+        }
+}
+
+// Set up the transforms for ninputs, given the input columns from
+// tabulate_inputs(). Returns 0 if out of memory.
+static inline int npn_init (Npn_table *nt, int ninputs, int negations,
+                     const Word *inputs) {
+    size_t count = 1;
+    for (int n = 2; n <= ninputs; ++n)
+        count *= n;
+    if (negations)
+        count *= (size_t) 2 << ninputs;
+    nt->ninputs = ninputs;
+    nt->ntransforms = 0;
+    nt->transforms = malloc (count * sizeof *nt->transforms);
+    nt->rowmaps = malloc (count << ninputs);
+    if (!nt->transforms || !nt->rowmaps)
+        return 0;
+    signed char perm[npn_max_inputs] = { 0 };
+    npn_add_permutations (nt, negations, inputs, perm, 0, 0);
+    return 1;
+}
+
+static inline void npn_free (Npn_table *nt) {
+    free (nt->transforms);
+    free (nt->rowmaps);
+}
+
+static inline Word npn_apply (const Npn_table *nt, int i, Word f) {
+    int n = nt->ninputs;
+    const unsigned char *rowmap = &nt->rowmaps[(size_t) i << n];
+    int o = nt->transforms[i].negate_output;
+    Word c = word_zero ();
+    for (int k = 0; k < 1 << n; ++k)
+        if (o ^ word_bit (f, rowmap[k]))
+            c = word_set_bit (c, k);
+    return c;
+}
+
+// Return f's canonical form, and in *transform how to get f back.
+static inline Word npn_canon (const Npn_table *nt, Word f, Npn *transform) {
+    Word best = npn_apply (nt, 0, f);
+    int best_i = 0;
+    for (int i = 1; i < nt->ntransforms; ++i) {
+        Word c = npn_apply (nt, i, f);
+        if (word_lt (c, best)) {
+            best = c;
+            best_i = i;
+        }
+    }
+    *transform = nt->transforms[best_i];
+    return best;
+}
+
+static inline void npn_identity (Npn *t, int ninputs) {
+    memset (t, 0, sizeof *t);
+    for (int w = 0; w < ninputs; ++w)
+        t->perm[w] = (signed char) w;
+}
+
+// Rewrite the circuit for c in linputs/rinputs[ninputs..nwires) as one
+// for f, into ls/rs, which need room for nwires + ninputs + 1 wires.
+// Returns the new wire count.
+static inline int npn_map_circuit (const Npn *t, int ninputs, int nwires,
+                            const int *linputs, const int *rinputs,
+                            int *ls, int *rs) {
+    int used = 0;
+    for (int g = ninputs; g < nwires; ++g)
+        used |= 1 << linputs[g] | 1 << rinputs[g];
+    int z[npn_max_inputs];
+    int w = ninputs;
+    for (int v = 0; v < ninputs; ++v) {
+        z[v] = t->perm[v];
+        if ((1 & (t->negate >> v)) && (1 & (used >> v))) {
+            ls[w] = rs[w] = t->perm[v];
+            z[v] = w++;
+        }
+    }
+    int shift = w - ninputs;
+    for (int g = ninputs; g < nwires; ++g, ++w) {
+        ls[w] = linputs[g] < ninputs ? z[linputs[g]] : linputs[g] + shift;
+        rs[w] = rinputs[g] < ninputs ? z[rinputs[g]] : rinputs[g] + shift;
+    }
+    if (t->negate_output) {
+        ls[w] = rs[w] = w-1;
+        ++w;
+    }
+    return w;
+}
+
+// A batch target with the canonical form it's searched for under.
+// Sorted by canonical form, then original, so each class is a run.
+typedef struct {
+    Word canonical, original;
+    Npn transform;
+} Npn_member;
+
+static inline int npn_compare_members (const void *a, const void *b) {
+    const Npn_member *ma = a, *mb = b;
+    if (!word_eq (ma->canonical, mb->canonical))
+        return word_lt (ma->canonical, mb->canonical) ? -1 : 1;
+    return word_lt (ma->original, mb->original) ? -1
+         : word_lt (mb->original, ma->original);
+}
+
+static inline void npn_sort_members (Npn_member *members, size_t n) {
+    qsort (members, n, sizeof *members, npn_compare_members);
+}
+
+// The first of the sorted members with this canonical form, or NULL.
+static inline const Npn_member *npn_class (const Npn_member *members, size_t n,
+                                    Word canonical) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (word_lt (members[mid].canonical, canonical))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < n && word_eq (members[lo].canonical, canonical)
+        ? &members[lo] : NULL;
+}
+
+#endif
@@ -0,0 +1,119 @@
+// The set of truth tables still wanted by a batch run. Up to 4
+// inputs a table is at most 16 bits, so the set is a bitmap indexed
+// by the table itself; past that it's an open-addressed hash set.
+// A target found is retired: it stays in the hash table as a
+// tombstone so later probes still get past it.
+//
+// The searches check ts_is_pending without a lock, from any thread;
+// ts_retire must be serialized by the caller.
+
+#ifndef TARGETSET_H
+#define TARGETSET_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "word.h"
+
+enum { ts_bitmap_inputs = 4 };
+enum { ts_empty = 0, ts_pending = 1, ts_retired = 2 };
+
+typedef struct {
+    int npending;
+    uint64_t *bitmap;           // when ninputs <= ts_bitmap_inputs
+    Word *keys;                 // otherwise
+    unsigned char *state;
+    size_t capacity;            // a power of 2
+} Target_set;
+
+static int ts_init (Target_set *ts, int ninputs, size_t max_targets) {
+    memset (ts, 0, sizeof *ts);
+    if (ninputs <= ts_bitmap_inputs) {
+        ts->bitmap = calloc (((size_t) 1 << (1 << ninputs)) / 64 + 1,
+                             sizeof *ts->bitmap);
+        return ts->bitmap != NULL;
+    }
+    ts->capacity = 16;
+    while (ts->capacity < 2 * max_targets)
+        ts->capacity *= 2;
+    ts->keys = calloc (ts->capacity, sizeof *ts->keys);
+    ts->state = calloc (ts->capacity, sizeof *ts->state);
+    return ts->keys && ts->state;
+}
+
+static void ts_free (Target_set *ts) {
+    free (ts->bitmap);
+    free (ts->keys);
+    free (ts->state);
+}
+
+static inline size_t ts_slot (const Target_set *ts, Word v) {
+    size_t i = (size_t) (word_hash (v) >> 32) & (ts->capacity - 1);
+    while (ts->state[i] != ts_empty && !word_eq (ts->keys[i], v))
+        i = (i + 1) & (ts->capacity - 1);
+    return i;
+}
+
+// Returns 1 if v wasn't already in the set.
+static int ts_add (Target_set *ts, Word v) {
+    if (ts->bitmap) {
+        uint64_t k = word_low64 (v), bit = (uint64_t) 1 << (k % 64);
+        if (ts->bitmap[k / 64] & bit)
+            return 0;
+        ts->bitmap[k / 64] |= bit;
+    } else {
+        size_t i = ts_slot (ts, v);
+        if (ts->state[i] != ts_empty)
+            return 0;
+        ts->keys[i] = v;
+        ts->state[i] = ts_pending;
+    }
+    ++ts->npending;
+    return 1;
+}
+
+static inline int ts_is_pending (const Target_set *ts, Word v) {
+    if (ts->bitmap) {
+        uint64_t k = word_low64 (v);
+        return 1 & (__atomic_load_n (&ts->bitmap[k / 64], __ATOMIC_RELAXED)
+                    >> (k % 64));
+    }
+    return __atomic_load_n (&ts->state[ts_slot (ts, v)], __ATOMIC_RELAXED)
+        == ts_pending;
+}
+
+// Returns 1 if v was pending, and retires it.
+static int ts_retire (Target_set *ts, Word v) {
+    if (!ts_is_pending (ts, v))
+        return 0;
+    if (ts->bitmap) {
+        uint64_t k = word_low64 (v);
+        __atomic_and_fetch (&ts->bitmap[k / 64], ~((uint64_t) 1 << (k % 64)),
+                            __ATOMIC_RELAXED);
+    } else
+        __atomic_store_n (&ts->state[ts_slot (ts, v)], ts_retired,
+                          __ATOMIC_RELAXED);
+    __atomic_sub_fetch (&ts->npending, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static inline int ts_npending (const Target_set *ts) {
+    return __atomic_load_n (&ts->npending, __ATOMIC_RELAXED);
+}
+
+// Call f on each pending target.
+static void ts_each_pending (const Target_set *ts, int ninputs,
+                             void (*f) (Word v)) {
+    if (ts->bitmap) {
+        for (uint64_t k = 0; k < (uint64_t) 1 << (1 << ninputs); ++k)
+            if (1 & (ts->bitmap[k / 64] >> (k % 64)))
+                f (word_from_low64 (k));
+    } else {
+        for (size_t i = 0; i < ts->capacity; ++i)
+            if (ts->state[i] == ts_pending)
+                f (ts->keys[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+// A transposition table for sweeping(): the partial circuits already
+// expanded, keyed by the multiset of their gates' truth tables (each
+// tagged with whether a later gate uses it yet), so a set of wire
+// values met again in another order can be skipped.
+//
+// It's bounded and lossy. Each bucket holds two entries: one kept for
+// the most gates remaining (the biggest subtree it can save), one
+// replaced by whatever came last. An entry is 56 bits of the key's
+// hash and 8 bits of gates remaining, read and written atomically and
+// without locks, so threads may share the table: a lost update only
+// costs a repeat search.
+
+#ifndef TRANSTABLE_H
+#define TRANSTABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "word.h"
+
+typedef struct {
+    uint64_t *entries;          // 2 per bucket
+    size_t nbuckets;            // a power of 2
+} Trans_table;
+
+// The multiset's hash is the sum of its gates' hashes, so it needs no
+// sorting.
+static inline uint64_t tt_gate_hash (Word v, int used) {
+    uint64_t h = word_hash (v) + (uint64_t) used;
+    return (h ^ (h >> 29)) * UINT64_C (0xBF58476D1CE4E5B9);
+}
+
+// Size the table to at most max_bytes. Returns 0 if that's too small
+// or out of memory.
+static inline int tt_init (Trans_table *tt, size_t max_bytes) {
+    tt->nbuckets = 0;
+    tt->entries = NULL;
+    size_t n = 1;
+    while (2 * n * 2 * sizeof *tt->entries <= max_bytes)
+        n *= 2;
+    if (n * 2 * sizeof *tt->entries > max_bytes)
+        return 0;
+    tt->entries = calloc (2 * n, sizeof *tt->entries);
+    tt->nbuckets = n;
+    return tt->entries != NULL;
+}
+
+static inline void tt_free (Trans_table *tt) {
+    free (tt->entries);
+}
+
+static inline void tt_clear (Trans_table *tt) {
+    memset (tt->entries, 0, 2 * tt->nbuckets * sizeof *tt->entries);
+}
+
+// Returns 1 if hash was already expanded with at least 'remaining'
+// gates to go. Otherwise records it and returns 0. remaining must be
+// between 1 and 255.
+static inline int tt_seen (Trans_table *tt, uint64_t hash, int remaining) {
+    uint64_t *bucket = &tt->entries[2 * (hash & (tt->nbuckets - 1))];
+    uint64_t check = hash & ~(uint64_t) 0xFF;
+    uint64_t deep = __atomic_load_n (&bucket[0], __ATOMIC_RELAXED);
+    uint64_t recent = __atomic_load_n (&bucket[1], __ATOMIC_RELAXED);
+    if (((deep & ~(uint64_t) 0xFF) == check && remaining <= (int) (deep & 0xFF))
+        || ((recent & ~(uint64_t) 0xFF) == check && remaining <= (int) (recent & 0xFF)))
+        return 1;
+    uint64_t entry = check | (uint64_t) remaining;
+    if ((int) (deep & 0xFF) <= remaining)
+        __atomic_store_n (&bucket[0], entry, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n (&bucket[1], entry, __ATOMIC_RELAXED);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,185 @@
+// Truth tables as bit-sliced words: bit k of a Word is row k of the
+// table. The width is fixed at compile time by MAX_INPUTS:
+//   5 (default)  unsigned
+//   6            uint64_t
+//   7            SSE2 __m128i
+//   8            AVX2 __m256i  (compile with -mavx2)
+// The scalar types keep the plain C operators, so the 5-input code
+// compiles just as it did before this header existed.
+
+#ifndef WORD_H
+#define WORD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef MAX_INPUTS
+#define MAX_INPUTS 5
+#endif
+
+enum { max_inputs = MAX_INPUTS };
+
+#if MAX_INPUTS <= 5
+typedef unsigned Word;
+#elif MAX_INPUTS == 6
+typedef uint64_t Word;
+#elif MAX_INPUTS == 7
+#include <emmintrin.h>
+typedef __m128i Word;
+#define WORD_VECTOR 1
+#elif MAX_INPUTS == 8
+#ifndef __AVX2__
+#error "MAX_INPUTS=8 needs -mavx2"
+#endif
+#include <immintrin.h>
+typedef __m256i Word;
+#define WORD_VECTOR 1
+#else
+#error "MAX_INPUTS must be at most 8"
+#endif
+
+#ifndef WORD_VECTOR
+
+static inline Word word_zero (void)              { return 0; }
+static inline Word word_nand (Word a, Word b)    { return ~(a & b); }
+static inline Word word_and (Word a, Word b)     { return a & b; }
+static inline Word word_xor (Word a, Word b)     { return a ^ b; }
+static inline int  word_popcount (Word a)        { return __builtin_popcountll (a); }
+static inline int  word_eq (Word a, Word b)      { return a == b; }
+static inline int  word_lt (Word a, Word b)      { return a < b; }
+static inline int  word_bit (Word a, int k)      { return 1 & (a >> k); }
+static inline Word word_set_bit (Word a, int k)  { return a | ((Word) 1 << k); }
+static inline uint64_t word_low64 (Word a)       { return a; }
+static inline Word word_from_low64 (uint64_t u)  { return (Word) u; }
+static inline uint64_t word_hash (Word a) {
+    return (uint64_t) a * UINT64_C (0x9E3779B97F4A7C15);
+}
+
+#else
+
+enum { word_lanes = sizeof (Word) / sizeof (uint64_t) };
+
+#if MAX_INPUTS == 7
+static inline Word word_zero (void) { return _mm_setzero_si128 (); }
+static inline Word word_nand (Word a, Word b) {
+    return _mm_xor_si128 (_mm_and_si128 (a, b), _mm_set1_epi32 (-1));
+}
+static inline Word word_and (Word a, Word b) { return _mm_and_si128 (a, b); }
+static inline Word word_xor (Word a, Word b) { return _mm_xor_si128 (a, b); }
+static inline int word_eq (Word a, Word b) {
+    return _mm_movemask_epi8 (_mm_cmpeq_epi8 (a, b)) == 0xFFFF;
+}
+#else
+static inline Word word_zero (void) { return _mm256_setzero_si256 (); }
+static inline Word word_nand (Word a, Word b) {
+    return _mm256_xor_si256 (_mm256_and_si256 (a, b), _mm256_set1_epi32 (-1));
+}
+static inline Word word_and (Word a, Word b) { return _mm256_and_si256 (a, b); }
+static inline Word word_xor (Word a, Word b) { return _mm256_xor_si256 (a, b); }
+static inline int word_eq (Word a, Word b) {
+    Word x = _mm256_xor_si256 (a, b);
+    return _mm256_testz_si256 (x, x);
+}
+#endif
+
+// Any consistent total order will do for symmetry pruning; this one
+// compares the 64-bit lanes from the top down, like a wide integer.
+static inline int word_lt (Word a, Word b) {
+    uint64_t la[word_lanes], lb[word_lanes];
+    memcpy (la, &a, sizeof a);
+    memcpy (lb, &b, sizeof b);
+    for (int i = word_lanes-1; 0 < i; --i)
+        if (la[i] != lb[i])
+            return la[i] < lb[i];
+    return la[0] < lb[0];
+}
+
+static inline int word_bit (Word a, int k) {
+    uint64_t lanes[word_lanes];
+    memcpy (lanes, &a, sizeof a);
+    return 1 & (lanes[k / 64] >> (k % 64));
+}
+
+static inline Word word_set_bit (Word a, int k) {
+    uint64_t lanes[word_lanes];
+    memcpy (lanes, &a, sizeof a);
+    lanes[k / 64] |= (uint64_t) 1 << (k % 64);
+    memcpy (&a, lanes, sizeof a);
+    return a;
+}
+
+static inline uint64_t word_low64 (Word a) {
+    uint64_t lanes[word_lanes];
+    memcpy (lanes, &a, sizeof a);
+    return lanes[0];
+}
+
+static inline Word word_from_low64 (uint64_t u) {
+    uint64_t lanes[word_lanes] = { u };
+    Word a;
+    memcpy (&a, lanes, sizeof a);
+    return a;
+}
+
+static inline int word_popcount (Word a) {
+    uint64_t lanes[word_lanes];
+    memcpy (lanes, &a, sizeof a);
+    int n = 0;
+    for (int i = 0; i < word_lanes; ++i)
+        n += __builtin_popcountll (lanes[i]);
+    return n;
+}
+
+static inline uint64_t word_hash (Word a) {
+    uint64_t lanes[word_lanes], h = 0;
+    memcpy (lanes, &a, sizeof a);
+    for (int i = 0; i < word_lanes; ++i)
+        h = (h ^ lanes[i]) * UINT64_C (0x9E3779B97F4A7C15);
+    return h;
+}
+
+#endif
+
+// The rows in use by an ninputs-input truth table.
+static inline Word word_mask (int ninputs) {
+    Word m = word_zero ();
+    for (int k = 0; k < 1 << ninputs; ++k)
+        m = word_set_bit (m, k);
+    return m;
+}
+
+// Parse a truth table written as binary digits, last row first. The
+// caller has checked the length. Returns 0 on a bad digit.
+static inline int word_parse (const char *s, Word *result) {
+    size_t n = strlen (s);
+    Word w = word_zero ();
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '1')
+            w = word_set_bit (w, (int) (n-1 - i));
+        else if (s[i] != '0')
+            return 0;
+    }
+    *result = w;
+    return 1;
+}
+
+// Like word_parse(), but an x is a don't-care: its row is clear in
+// both *result and *care, and the others are set in *care.
+static inline int word_parse_care (const char *s, Word *result, Word *care) {
+    size_t n = strlen (s);
+    Word w = word_zero (), c = word_zero ();
+    for (size_t i = 0; i < n; ++i) {
+        int k = (int) (n-1 - i);
+        if (s[i] == '1')
+            w = word_set_bit (w, k);
+        else if (s[i] != '0' && s[i] != 'x')
+            return 0;
+        if (s[i] != 'x')
+            c = word_set_bit (c, k);
+    }
+    *result = w;
+    *care = c;
+    return 1;
+}
+
+#endif
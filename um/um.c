@@ -0,0 +1,665 @@
+// gcc -std=gnu99 -W -Wall -g2 -O2 um.c -o um
+// (add -DUM_SWITCH to dispatch through a switch instead, and
+// -DUM_PROFILE to count each op run)
+
+// The Universal Machine of http://www.boundvariable.org/task.shtml,
+// with the same semantics as um.lua, fast enough for real images.
+// The registers are locals, arrays are flat runs of uint32_t, and
+// dispatch is threaded with GCC's computed goto: each instruction
+// jumps straight to the next one's handler through a table indexed by
+// opcode. Output is buffered, and flushed before reading input and on
+// halting.
+//
+// Arrays come from an arena: small ones from slabs, by power-of-2 size
+// class, and go back on their class's free list when abandoned, so
+// alloc is a pop and a memset. Load doesn't copy: array 0 shares the
+// loaded array, and whichever of them is amended first gets copied
+// then. The usual load, of a freshly built program that's never
+// amended, costs nothing.
+//
+// Array 0 doesn't run as it is, but translated: each basic block is
+// decoded once, on first reaching it, into Insns that keep the fields
+// apart, and an ortho fuses with the op after it. --interpret runs the
+// words directly instead, for comparison.
+//
+// With --stats, report the instructions executed per second on stderr,
+// and in a -DUM_PROFILE build how many of them were each op.
+// umbench.py times it on the test images of umasm.py, checking its
+// output against um.lua's.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined (__GNUC__) && !defined (UM_SWITCH)
+#define UM_SWITCH 1
+#endif
+
+enum { op_cmov, op_index, op_amend, op_add, op_mul, op_div, op_nand,
+       op_halt, op_alloc, op_aband, op_output, op_input, op_load,
+       op_ortho };
+
+// A translated instruction. xop_translate, 0, is an Insn not decoded
+// yet; the plain ops are op_ + 1; xop_ortho_X is an ortho and then
+// an X, with the ortho's register in oa.
+enum { xop_translate,
+       xop_cmov, xop_index, xop_amend, xop_add, xop_mul, xop_div, xop_nand,
+       xop_halt, xop_alloc, xop_aband, xop_output, xop_input, xop_load,
+       xop_ortho, xop_bad,
+       xop_ortho_cmov, xop_ortho_index, xop_ortho_amend, xop_ortho_add,
+       xop_ortho_mul, xop_ortho_div, xop_ortho_nand, xop_ortho_output,
+       xop_ortho_load, nxops };
+
+typedef struct {
+    const void *handler;        // with computed goto, op's code in run()
+    uint8_t op;                 // an xop_
+    uint8_t a, b, c;            // register numbers
+    uint8_t oa;                 // an ortho's
+    uint32_t value;             // an ortho's
+} Insn;
+
+// Profiling, compiled in with -DUM_PROFILE. Without it COUNT_OP() and
+// COUNT_XOP() expand to nothing.
+#ifdef UM_PROFILE
+static uint64_t op_counts[16];          // by opcode, from interpret()
+static uint64_t xop_counts[nxops];      // by xop, from run()
+#define COUNT_OP(op) (++op_counts[op])
+#define COUNT_XOP(op) (++xop_counts[op])
+#else
+#define COUNT_OP(op) ((void) 0)
+#define COUNT_XOP(op) ((void) 0)
+#endif
+
+static const char *argv0 = "";
+
+static void error (const char *plaint) {
+    fprintf (stderr, "%s: %s\n", argv0, plaint);
+    exit (1);
+}
+
+// Output.
+
+enum { out_size = 1 << 16 };
+static unsigned char out_buffer[out_size];
+static size_t out_length = 0;
+
+static void flush_out (void) {
+    if (out_length != 0 && fwrite (out_buffer, 1, out_length, stdout) != out_length)
+        error (strerror (errno));
+    out_length = 0;
+    fflush (stdout);
+}
+
+static void out_byte (uint32_t c) {
+    if (out_length == out_size)
+        flush_out ();
+    out_buffer[out_length++] = (unsigned char) c;
+}
+
+// Arrays. Each is its words after a Header. An id is an index into
+// arrays[]; abandoned ids are reused, the most recently abandoned
+// first, as in um.lua.
+
+typedef struct Header {
+    struct Header *next_free;   // on its class's free list
+    uint32_t size;
+    uint32_t refs;              // ids sharing it: array 0 after a load
+    uint32_t size_class;        // large_class if not from a slab
+    Insn *code;                 // its translation, once it's been run
+} Header;
+
+// Class k holds arrays of up to 2^k words.
+enum { max_small_class = 16, large_class = max_small_class + 1 };
+enum { slab_bytes = 1 << 20 };
+
+static Header *free_blocks[max_small_class + 1];
+static char *slab = NULL;
+static size_t slab_left = 0;
+
+static uint32_t **arrays = NULL;        // by id; NULL if abandoned
+static uint32_t narrays = 0, arrays_capacity = 0;
+static uint32_t *free_ids = NULL;
+static uint32_t nfree = 0, free_capacity = 0;
+
+static void *grow (void *p, uint32_t *capacity, size_t size) {
+    *capacity = *capacity ? 2 * *capacity : 64;
+    p = realloc (p, *capacity * size);
+    if (!p)
+        error ("Out of memory");
+    return p;
+}
+
+static Header *header (const uint32_t *a) {
+    return (Header *) a - 1;
+}
+
+static uint32_t size_class (uint32_t size) {
+    uint32_t k = size <= 1 ? 0 : 32 - __builtin_clz (size - 1);
+    return k <= max_small_class ? k : large_class;
+}
+
+// A new array of size words, not zeroed, with one ref.
+static uint32_t *new_array (uint32_t size) {
+    uint32_t k = size_class (size);
+    Header *h;
+    if (k == large_class) {
+        h = malloc (sizeof *h + (size_t) size * sizeof (uint32_t));
+        if (!h)
+            error ("Out of memory");
+    } else if (free_blocks[k]) {
+        h = free_blocks[k];
+        free_blocks[k] = h->next_free;
+    } else {
+        size_t bytes = sizeof *h + ((size_t) sizeof (uint32_t) << k);
+        bytes = (bytes + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
+        if (slab_left < bytes) {
+            slab = malloc (slab_bytes);
+            if (!slab)
+                error ("Out of memory");
+            slab_left = slab_bytes;
+        }
+        h = (Header *) slab;
+        slab += bytes;
+        slab_left -= bytes;
+    }
+    h->size = size;
+    h->refs = 1;
+    h->size_class = k;
+    h->code = NULL;
+    return (uint32_t *) (h + 1);
+}
+
+static uint32_t *new_zeroed_array (uint32_t size) {
+    uint32_t *a = new_array (size);
+    memset (a, 0, (size_t) size * sizeof *a);
+    return a;
+}
+
+static uint32_t array_size (const uint32_t *a) {
+    return header (a)->size;
+}
+
+// Drop a ref to a, freeing it with the last.
+static void release (uint32_t *a) {
+    Header *h = header (a);
+    if (--h->refs != 0)
+        return;
+    free (h->code);
+    if (h->size_class == large_class)
+        free (h);
+    else {
+        h->next_free = free_blocks[h->size_class];
+        free_blocks[h->size_class] = h;
+    }
+}
+
+// Before amending array id, give it its own copy if it's shared.
+// Returns the array.
+static uint32_t *unshare (uint32_t id) {
+    uint32_t *from = arrays[id];
+    if (header (from)->refs == 1)
+        return from;
+    uint32_t size = array_size (from);
+    uint32_t *a = new_array (size);
+    memcpy (a, from, (size_t) size * sizeof *a);
+    release (from);
+    return arrays[id] = a;
+}
+
+static uint32_t allocate (uint32_t size) {
+    uint32_t id;
+    if (nfree != 0)
+        id = free_ids[--nfree];
+    else {
+        if (narrays == arrays_capacity)
+            arrays = grow (arrays, &arrays_capacity, sizeof *arrays);
+        id = narrays++;
+    }
+    arrays[id] = new_zeroed_array (size);
+    return id;
+}
+
+static void abandon (uint32_t id) {
+    release (arrays[id]);
+    arrays[id] = NULL;
+    if (nfree == free_capacity)
+        free_ids = grow (free_ids, &free_capacity, sizeof *free_ids);
+    free_ids[nfree++] = id;
+}
+
+// Array 0 becomes a copy of array id, shared until one is amended.
+static uint32_t *load (uint32_t id) {
+    uint32_t *program = arrays[id];
+    ++header (program)->refs;
+    release (arrays[0]);
+    return arrays[0] = program;
+}
+
+// Read the program, big-endian words, into array 0.
+static void read_program (const char *filename) {
+    FILE *f = fopen (filename, "rb");
+    if (!f)
+        error (strerror (errno));
+    size_t length = 0, capacity = 1 << 16;
+    unsigned char *bytes = malloc (capacity);
+    size_t n;
+    while (bytes && (n = fread (bytes + length, 1, capacity - length, f)) != 0) {
+        length += n;
+        if (length == capacity)
+            bytes = realloc (bytes, capacity *= 2);
+    }
+    if (!bytes)
+        error ("Out of memory");
+    if (ferror (f))
+        error (strerror (errno));
+    fclose (f);
+    if (length % 4 != 0)
+        error ("The program's size isn't a multiple of 4 bytes");
+    uint32_t size = (uint32_t) (length / 4);
+    if (allocate (size) != 0)
+        error ("Array 0 is taken");
+    uint32_t *program = arrays[0];
+    for (uint32_t i = 0; i < size; ++i) {
+        const unsigned char *b = bytes + 4 * (size_t) i;
+        program[i] = (uint32_t) b[0] << 24 | (uint32_t) b[1] << 16
+                   | (uint32_t) b[2] << 8 | b[3];
+    }
+    free (bytes);
+}
+
+// What each instruction does, given the registers A, B and C, which
+// each runner defines. Amend and load are up to the runners.
+#define DO_CMOV do {                            \
+        if (C)                                  \
+            A = B;                              \
+    } while (0)
+#define DO_INDEX (A = arrays[B][C])
+#define DO_ADD (A = B + C)
+#define DO_MUL (A = B * C)
+#define DO_DIV (A = C ? B / C : 0)      // as um.lua does, for lack of a rule
+#define DO_NAND (A = ~(B & C))
+#define DO_ALLOC do {                           \
+        uint32_t id = allocate (C);             \
+        B = id;                                 \
+    } while (0)
+#define DO_ABAND abandon (C)
+#define DO_OUTPUT out_byte (C)
+#define DO_INPUT do {                                   \
+        flush_out ();                                   \
+        int c = getchar ();                             \
+        C = c == EOF ? 0xFFFFFFFF : (uint32_t) c;       \
+    } while (0)
+
+static void bad_opcode (void) {
+    flush_out ();
+    printf ("Bad opcode\n");
+    exit (1);
+}
+
+// Run the words of array 0 until halt. Returns the instructions
+// executed.
+static uint64_t interpret (void) {
+    uint32_t r[8] = { 0 };
+    uint32_t *program = arrays[0];
+    uint32_t pc = 0, inst;
+    uint64_t count = 0;
+
+#define A r[7 & (inst >> 6)]
+#define B r[7 & (inst >> 3)]
+#define C r[7 & inst]
+
+#ifdef UM_SWITCH
+#define OP(name) case op_##name
+#define NEXT continue
+    for (;;) {
+        inst = program[pc++];
+        ++count;
+        COUNT_OP (inst >> 28);
+        switch (inst >> 28) {
+#else
+#define OP(name) do_##name
+#define NEXT do {                               \
+        inst = program[pc++];                   \
+        ++count;                                \
+        COUNT_OP (inst >> 28);                  \
+        goto *dispatch[inst >> 28];             \
+    } while (0)
+    static void *const dispatch[16] = {
+        &&do_cmov, &&do_index, &&do_amend, &&do_add, &&do_mul, &&do_div,
+        &&do_nand, &&do_halt, &&do_alloc, &&do_aband, &&do_output,
+        &&do_input, &&do_load, &&do_ortho, &&do_bad, &&do_bad
+    };
+    NEXT;
+#endif
+
+    OP(cmov):   DO_CMOV;   NEXT;
+    OP(index):  DO_INDEX;  NEXT;
+    OP(amend): {
+            uint32_t *a = arrays[A];
+            if (header (a)->refs != 1) {
+                a = unshare (A);
+                program = arrays[0];
+            }
+            a[B] = C;
+        }
+        NEXT;
+    OP(add):    DO_ADD;    NEXT;
+    OP(mul):    DO_MUL;    NEXT;
+    OP(div):    DO_DIV;    NEXT;
+    OP(nand):   DO_NAND;   NEXT;
+    OP(halt):
+        return count;
+    OP(alloc):  DO_ALLOC;  NEXT;
+    OP(aband):  DO_ABAND;  NEXT;
+    OP(output): DO_OUTPUT; NEXT;
+    OP(input):  DO_INPUT;  NEXT;
+    OP(load):
+        if (B != 0)
+            program = load (B);
+        pc = C;
+        NEXT;
+    OP(ortho):
+        r[7 & (inst >> 25)] = inst & 0x1FFFFFF;
+        NEXT;
+
+#ifdef UM_SWITCH
+        default:
+            break;
+        }
+        break;
+    }
+#else
+  do_bad:
+#endif
+    bad_opcode ();
+    return count;
+
+#undef A
+#undef B
+#undef C
+#undef OP
+#undef NEXT
+}
+
+// Translation. An array's Insns, one per word and one more past the
+// end, are kept in its header, so loading the same array again finds
+// them decoded. Amending a word clears its Insn and the one before,
+// which may have fused it; the next time through decodes them again.
+
+enum { max_block = 256 };
+
+// With computed goto, run()'s handlers by xop, so that each Insn can
+// jump straight to the next one's.
+static const void *const *handlers = NULL;
+
+static void set_op (Insn *x, int op) {
+    x->op = (uint8_t) op;
+    if (handlers)
+        x->handler = handlers[op];
+}
+
+// The fused op for an ortho followed by each op, or 0 for none.
+static const uint8_t fused_ops[16] = {
+    [op_cmov] = xop_ortho_cmov, [op_index] = xop_ortho_index,
+    [op_amend] = xop_ortho_amend, [op_add] = xop_ortho_add,
+    [op_mul] = xop_ortho_mul, [op_div] = xop_ortho_div,
+    [op_nand] = xop_ortho_nand, [op_output] = xop_ortho_output,
+    [op_load] = xop_ortho_load,
+};
+
+static Insn *code_of (uint32_t *a) {
+    Header *h = header (a);
+    if (!h->code) {
+        h->code = calloc ((size_t) h->size + 1, sizeof *h->code);
+        if (!h->code)
+            error ("Out of memory");
+        for (uint32_t i = 0; handlers && i <= h->size; ++i)
+            h->code[i].handler = handlers[xop_translate];
+    }
+    return h->code;
+}
+
+// Decode the basic block at pc: up to a halt, load or bad opcode, a
+// word already decoded, or max_block words.
+static void translate (Insn *code, const uint32_t *words, uint32_t size,
+                       uint32_t pc) {
+    if (size <= pc)
+        error ("The program counter ran off the end of array 0");
+    for (uint32_t i = pc; i < size && i - pc < max_block; ++i) {
+        Insn *x = &code[i];
+        if (i != pc && x->op != xop_translate)
+            break;
+        uint32_t w = words[i], op = w >> 28;
+        if (op == op_ortho) {
+            set_op (x, xop_ortho);
+            x->oa = 7 & (w >> 25);
+            x->value = w & 0x1FFFFFF;
+        } else {
+            set_op (x, op < op_ortho ? op + 1 : xop_bad);
+            x->a = 7 & (w >> 6);
+            x->b = 7 & (w >> 3);
+            x->c = 7 & w;
+        }
+        if (pc < i && x[-1].op == xop_ortho && fused_ops[op]) {
+            set_op (&x[-1], fused_ops[op]);
+            x[-1].a = x->a;
+            x[-1].b = x->b;
+            x[-1].c = x->c;
+        }
+        if (x->op == xop_halt || x->op == xop_load || x->op == xop_bad)
+            break;
+    }
+}
+
+// Amend word i of array id, which is shared or translated.
+static void amend (uint32_t id, uint32_t i, uint32_t value) {
+    uint32_t *a = unshare (id);
+    a[i] = value;
+    Insn *code = header (a)->code;
+    if (code) {
+        set_op (&code[i], xop_translate);
+        if (i != 0)
+            set_op (&code[i-1], xop_translate);
+    }
+}
+
+// Run array 0, translated, until halt. Returns the instructions
+// executed. I, the Insn running, is the program counter.
+static uint64_t run (void) {
+    uint32_t r[8] = { 0 };
+    uint32_t size = array_size (arrays[0]);
+    Insn *code;
+    const Insn *I;
+    uint64_t count = 0;
+
+#define A r[I->a]
+#define B r[I->b]
+#define C r[I->c]
+#define ORTHO (r[I->oa] = I->value)
+#define DO_AMEND do {                                           \
+        uint32_t *a = arrays[A];                                \
+        if (header (a)->refs != 1 || header (a)->code) {        \
+            ptrdiff_t pc = I - code;                            \
+            amend (A, B, C);                                    \
+            code = code_of (arrays[0]);                         \
+            I = code + pc;                                      \
+        } else                                                  \
+            a[B] = C;                                           \
+    } while (0)
+#define DO_LOAD do {                                            \
+        uint32_t pc = C;        /* before load() frees I */     \
+        if (B != 0) {                                           \
+            code = code_of (load (B));                          \
+            size = array_size (arrays[0]);                      \
+        }                                                       \
+        if (size < pc)                                          \
+            error ("Load past the end of array 0");             \
+        I = code + pc;                                          \
+    } while (0)
+
+#ifdef UM_SWITCH
+#define OP(name) case xop_##name
+#define DISPATCH continue
+    code = code_of (arrays[0]);
+    I = code;
+    for (;;) {
+        COUNT_XOP (I->op);
+        switch (I->op) {
+#else
+#define OP(name) do_##name
+#define DISPATCH do {                           \
+        COUNT_XOP (I->op);                      \
+        goto *I->handler;                       \
+    } while (0)
+    static const void *const dispatch[nxops] = {
+        &&do_translate,
+        &&do_cmov, &&do_index, &&do_amend, &&do_add, &&do_mul, &&do_div,
+        &&do_nand, &&do_halt, &&do_alloc, &&do_aband, &&do_output,
+        &&do_input, &&do_load, &&do_ortho, &&do_bad,
+        &&do_ortho_cmov, &&do_ortho_index, &&do_ortho_amend, &&do_ortho_add,
+        &&do_ortho_mul, &&do_ortho_div, &&do_ortho_nand, &&do_ortho_output,
+        &&do_ortho_load
+    };
+    handlers = dispatch;
+    code = code_of (arrays[0]);
+    I = code;
+    DISPATCH;
+#endif
+// (Not wrapped in a do-while: DISPATCH may be a continue.)
+#define STEP(n) I += n; count += n; DISPATCH
+
+    OP(translate):
+        translate (code, arrays[0], size, (uint32_t) (I - code));
+        DISPATCH;
+    OP(cmov):   DO_CMOV;   STEP (1);
+    OP(index):  DO_INDEX;  STEP (1);
+    OP(amend):  DO_AMEND;  STEP (1);
+    OP(add):    DO_ADD;    STEP (1);
+    OP(mul):    DO_MUL;    STEP (1);
+    OP(div):    DO_DIV;    STEP (1);
+    OP(nand):   DO_NAND;   STEP (1);
+    OP(halt):
+        return count + 1;
+    OP(alloc):  DO_ALLOC;  STEP (1);
+    OP(aband):  DO_ABAND;  STEP (1);
+    OP(output): DO_OUTPUT; STEP (1);
+    OP(input):  DO_INPUT;  STEP (1);
+    OP(load):
+        count += 1;
+        DO_LOAD;
+        DISPATCH;
+    OP(ortho):  ORTHO;     STEP (1);
+
+    OP(ortho_cmov):   ORTHO; DO_CMOV;   STEP (2);
+    OP(ortho_index):  ORTHO; DO_INDEX;  STEP (2);
+    OP(ortho_amend):  ORTHO; DO_AMEND;  STEP (2);
+    OP(ortho_add):    ORTHO; DO_ADD;    STEP (2);
+    OP(ortho_mul):    ORTHO; DO_MUL;    STEP (2);
+    OP(ortho_div):    ORTHO; DO_DIV;    STEP (2);
+    OP(ortho_nand):   ORTHO; DO_NAND;   STEP (2);
+    OP(ortho_output): ORTHO; DO_OUTPUT; STEP (2);
+    OP(ortho_load):
+        ORTHO;
+        count += 2;
+        DO_LOAD;
+        DISPATCH;
+
+    OP(bad):
+#ifdef UM_SWITCH
+        default:
+            break;
+        }
+        break;
+    }
+#endif
+    bad_opcode ();
+    return count;
+
+#undef A
+#undef B
+#undef C
+#undef ORTHO
+#undef DO_AMEND
+#undef DO_LOAD
+#undef OP
+#undef DISPATCH
+#undef STEP
+}
+
+#ifdef UM_PROFILE
+static const char *const op_names[op_ortho + 1] = {
+    "cmov", "index", "amend", "add", "mul", "div", "nand", "halt",
+    "alloc", "aband", "output", "input", "load", "ortho"
+};
+
+// Report the ops run, out of count, with a fused pair counting as
+// both of its ops; and how often run() dispatched and translated.
+static void report_profile (uint64_t count) {
+    uint64_t n[op_ortho + 1], dispatches = 0, fused = 0;
+    for (int op = 0; op <= op_ortho; ++op) {
+        n[op] = op_counts[op] + xop_counts[op + 1];
+        dispatches += xop_counts[op + 1];
+    }
+    for (int op = 0; op < 16; ++op)
+        if (fused_ops[op]) {
+            uint64_t k = xop_counts[fused_ops[op]];
+            n[op] += k;
+            n[op_ortho] += k;
+            dispatches += k;
+            fused += k;
+        }
+    for (int op = 0; op <= op_ortho; ++op)
+        fprintf (stderr, "%-8s %14llu %5.1f%%\n", op_names[op],
+                 (unsigned long long) n[op],
+                 0 < count ? 100.0 * n[op] / count : 0);
+    if (dispatches != 0)
+        fprintf (stderr, "%llu dispatches, %llu of them fused pairs; "
+                 "%llu blocks translated\n",
+                 (unsigned long long) dispatches, (unsigned long long) fused,
+                 (unsigned long long) xop_counts[xop_translate]);
+}
+#endif
+
+static double now (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static const char usage[] = "Usage: um [--stats] [--interpret] program.um";
+
+int main (int argc, char **argv) {
+    argv0 = argv[0];
+    int stats = 0, translated = 1;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] == '-'; ++i) {
+        if (strcmp (argv[i], "--stats") == 0)
+            stats = 1;
+        else if (strcmp (argv[i], "--interpret") == 0)
+            translated = 0;
+        else
+            error (usage);
+    }
+    if (argc - i != 1)
+        error (usage);
+    read_program (argv[i]);
+    double start = now ();
+    uint64_t count = translated ? run () : interpret ();
+    double seconds = now () - start;
+    flush_out ();
+    if (stats)
+        fprintf (stderr, "%llu instructions in %.3f s (%.3g instructions/s)\n",
+                 (unsigned long long) count, seconds,
+                 0 < seconds ? count / seconds : 0);
+#ifdef UM_PROFILE
+    if (stats)
+        report_profile (count);
+#endif
+    return 0;
+}
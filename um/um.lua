@@ -97,7 +97,7 @@ while true do
 
       elseif opcode == 8 then   -- alloc
          local i
-         if #freelist == 0 then --XXX not sure this is right
+         if #freelist == 0 then -- so no holes in mem: #mem is its last id
             i = #mem+1
          else
             i = freelist[#freelist]
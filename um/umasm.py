@@ -0,0 +1,312 @@
+"""
+An assembler for the Universal Machine, and the test images that
+umbench.py runs um.c and um.lua on. Nothing here is random: the same
+scale always makes the same images, and each image prints what it
+computed, so implementations can be checked against each other by
+their output.
+
+Usage: python3 umasm.py [--scale S] directory
+writes arith.um, churn.um, selfmod.um, loads.um and output.um there.
+
+The macros assume that r0 stays 0, and use r6 and r7 as scratch: a
+program has r1 to r5 to itself.
+"""
+
+import struct
+import sys
+
+class Asm:
+    "A program under construction. image() makes its bytes."
+
+    def __init__(self):
+        self.words = []
+        self.labels = {}
+        self.fixups = []        # (address, label) of orthos to labels
+        self.nfresh = 0
+
+    def here(self):
+        return len(self.words)
+
+    def label(self, name):
+        assert name not in self.labels, name
+        self.labels[name] = self.here()
+
+    def fresh(self):
+        "A label name not used yet."
+        self.nfresh += 1
+        return ' %d' % self.nfresh
+
+    def op(self, opcode, a=0, b=0, c=0):
+        self.words.append((opcode << 28) | (a << 6) | (b << 3) | c)
+
+    def cmov(self, a, b, c):  self.op(0, a, b, c)    # if c: a = b
+    def index(self, a, b, c): self.op(1, a, b, c)    # a = b[c]
+    def amend(self, a, b, c): self.op(2, a, b, c)    # a[b] = c
+    def add(self, a, b, c):   self.op(3, a, b, c)
+    def mul(self, a, b, c):   self.op(4, a, b, c)
+    def div(self, a, b, c):   self.op(5, a, b, c)
+    def nand(self, a, b, c):  self.op(6, a, b, c)
+    def halt(self):           self.op(7)
+    def alloc(self, b, c):    self.op(8, 0, b, c)    # b = new c words
+    def aband(self, c):       self.op(9, 0, 0, c)
+    def output(self, c):      self.op(10, 0, 0, c)
+    def input(self, c):       self.op(11, 0, 0, c)
+    def load(self, b, c):     self.op(12, 0, b, c)   # array 0 = b; pc = c
+
+    def ortho(self, a, value):
+        "a = value, a number below 2**25 or a label."
+        if isinstance(value, str):
+            self.fixups.append((self.here(), value))
+            value = 0
+        assert 0 <= value < 1 << 25, value
+        self.words.append(ortho_word(a, value))
+
+    def data(self, words):
+        self.words.extend(words)
+
+    def image(self):
+        words = list(self.words)
+        labels = dict(self.labels)
+        if any(label == 'hex digits' for _, label in self.fixups):
+            labels['hex digits'] = len(words)
+            words += [ord(ch) for ch in '0123456789abcdef']
+        for address, label in self.fixups:
+            words[address] |= labels[label]
+        return struct.pack('>%dI' % len(words), *words)
+
+    # Macros.
+
+    def const(self, a, value):
+        "a = value, any 32-bit number."
+        assert a != 7
+        if value < 1 << 25:
+            self.ortho(a, value)
+            return
+        self.ortho(a, value >> 16)
+        self.ortho(7, 1 << 16)
+        self.mul(a, a, 7)
+        self.ortho(7, value & 0xFFFF)
+        self.add(a, a, 7)
+
+    def band(self, a, b, c):
+        "a = b & c."
+        self.nand(a, b, c)
+        self.nand(a, a, a)
+
+    def jump(self, label):
+        self.ortho(7, label)
+        self.load(0, 7)
+
+    def jnz(self, c, label):
+        "Jump to label if c isn't 0."
+        after = self.fresh()
+        self.ortho(7, after)
+        self.ortho(6, label)
+        self.cmov(7, 6, c)
+        self.load(0, 7)
+        self.label(after)
+
+    def loop(self, a, label):
+        "Decrement a, and go back to label unless that made it 0."
+        self.nand(6, 0, 0)
+        self.add(a, a, 6)
+        self.jnz(a, label)
+
+    def lcg(self, a):
+        "Step a, as a linear congruential generator."
+        self.ortho(6, 69069)
+        self.mul(a, a, 6)
+        self.ortho(6, 12345)
+        self.add(a, a, 6)
+
+    def put(self, string):
+        for ch in string:
+            self.ortho(7, ord(ch))
+            self.output(7)
+
+    def put_hex(self, a):
+        "Print a in 8 hex digits, leaving it 0."
+        for _ in range(8):
+            self.ortho(6, 1 << 14)
+            self.div(7, a, 6)
+            self.div(7, 7, 6)
+            self.ortho(6, 16)
+            self.mul(a, a, 6)
+            self.ortho(6, 'hex digits')
+            self.add(7, 7, 6)
+            self.index(7, 0, 7)
+            self.output(7)
+
+def ortho_word(a, value):
+    return (13 << 28) | (a << 25) | value
+
+def put_results(m, registers):
+    "Print the registers in hex, on a line, and halt."
+    for i, r in enumerate(registers):
+        if i: m.put(' ')
+        m.put_hex(r)
+    m.put('\n')
+    m.halt()
+
+# The images. Each takes a repeat count n.
+
+def arith(n):
+    "A loop of arithmetic, n times round."
+    m = Asm()
+    m.const(1, n)
+    m.label('loop')
+    m.lcg(3)
+    m.nand(4, 4, 3)
+    m.ortho(6, 7)
+    m.div(6, 3, 6)
+    m.add(5, 5, 6)
+    m.add(5, 5, 4)
+    m.cmov(2, 3, 4)
+    m.add(5, 5, 2)
+    m.loop(1, 'loop')
+    put_results(m, [3, 4, 5])
+    return m
+
+def churn(n):
+    """n allocations of 1 to 1024 words, each abandoning the one made
+    64 allocations before. Each new array's first and last words are
+    read back, to check that arrays come zeroed."""
+    m = Asm()
+    m.ortho(1, 64)
+    m.alloc(2, 1)               # the live arrays
+    m.label('fill')
+    m.nand(6, 0, 0)
+    m.add(1, 1, 6)
+    m.ortho(6, 1)
+    m.alloc(4, 6)
+    m.amend(2, 1, 4)
+    m.jnz(1, 'fill')
+    m.const(1, n)
+    m.label('loop')
+    m.lcg(3)
+    m.ortho(6, 63)
+    m.band(4, 1, 6)
+    m.index(6, 2, 4)
+    m.aband(6)
+    m.ortho(6, 1 << 22)
+    m.div(6, 3, 6)
+    m.ortho(7, 1)
+    m.add(6, 6, 7)              # its size
+    m.alloc(7, 6)
+    m.amend(2, 4, 7)
+    m.nand(4, 0, 0)
+    m.add(6, 6, 4)
+    m.index(6, 7, 6)            # its last word, 0
+    m.add(5, 5, 6)
+    m.amend(7, 0, 3)
+    m.index(6, 7, 0)
+    m.add(5, 5, 6)
+    m.loop(1, 'loop')
+    put_results(m, [5])
+    return m
+
+def selfmod(n):
+    "A loop that amends one of its own orthos, n times round."
+    m = Asm()
+    m.const(2, ortho_word(4, 0))
+    m.const(1, n)
+    m.label('loop')
+    m.ortho(6, 0xFFFF)
+    m.band(7, 1, 6)
+    m.add(7, 7, 2)
+    m.ortho(6, 'patch')
+    m.amend(0, 6, 7)
+    m.label('patch')
+    m.ortho(4, 0)
+    m.add(5, 5, 4)
+    m.loop(1, 'loop')
+    put_results(m, [5])
+    return m
+
+def loads(n, size=1024):
+    """n loads, alternating between two copies of the program that
+    differ in one ortho, padded to size words."""
+    m = Asm()
+    m.ortho(1, size)
+    m.alloc(2, 1)
+    m.alloc(3, 1)
+    m.label('copy')
+    m.nand(6, 0, 0)
+    m.add(1, 1, 6)
+    m.index(4, 0, 1)
+    m.amend(2, 1, 4)
+    m.amend(3, 1, 4)
+    m.jnz(1, 'copy')
+    m.const(4, ortho_word(4, 2))
+    m.ortho(6, 'which')
+    m.amend(3, 6, 4)
+    m.const(1, n)
+    m.label('which')
+    m.ortho(4, 1)
+    m.add(5, 5, 4)
+    m.nand(6, 0, 0)
+    m.add(1, 1, 6)
+    m.jnz(1, 'again')
+    put_results(m, [5])
+    m.label('again')
+    m.ortho(7, 1)
+    m.band(4, 1, 7)
+    m.add(6, 2, 0)
+    m.cmov(6, 3, 4)
+    m.ortho(7, 'which')
+    m.load(6, 7)
+    m.data([0] * (size - m.here() - 16))    # (less the hex digits)
+    return m
+
+def output(n):
+    "n lines of 64 letters."
+    m = Asm()
+    m.const(1, n)
+    m.label('loop')
+    for _ in range(64):
+        m.lcg(3)
+        m.ortho(6, 1 << 13)
+        m.div(4, 3, 6)
+        m.ortho(6, 1 << 14)
+        m.div(4, 4, 6)
+        m.ortho(6, ord('A'))
+        m.add(4, 4, 6)
+        m.output(4)
+    m.put('\n')
+    m.loop(1, 'loop')
+    m.halt()
+    return m
+
+# Each image's maker and n at scale 1, which takes um.c a few tenths
+# of a second.
+images = [
+    ('arith', arith, 2000000),
+    ('churn', churn, 500000),
+    ('selfmod', selfmod, 500000),
+    ('loads', loads, 1000000),
+    ('output', output, 20000),
+]
+
+def generate(directory, scale=1.0):
+    "Write the images into directory, returning their paths."
+    paths = []
+    for name, make, n in images:
+        path = '%s/%s.um' % (directory, name)
+        with open(path, 'wb') as f:
+            f.write(make(max(1, int(n * scale))).image())
+        paths.append(path)
+    return paths
+
+def main(argv):
+    usage = 'Usage: python3 umasm.py [--scale S] directory'
+    scale = 1.0
+    if argv[:1] == ['--scale'] and 2 < len(argv):
+        scale = float(argv[1])
+        argv = argv[2:]
+    if len(argv) != 1 or argv[0].startswith('--'):
+        sys.exit(usage)
+    for path in generate(argv[0], scale):
+        print(path)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,136 @@
+"""
+Run each UM implementation on the images umasm.py makes, check that
+they all print the same, and report how fast they ran.
+
+Usage: python3 umbench.py [--scale S] [--trials N] [--lua COMMAND]
+                          [--out FILE] [--dir DIR]
+
+Builds um.c as um, um-switch (-DUM_SWITCH) and um-profile
+(-DUM_PROFILE), and the images, into a temporary directory that's
+removed at the end, or into DIR, which is kept. The runs are um,
+um --interpret, um-switch, um-switch --interpret, and um.lua under
+COMMAND (by default lua5.2 or lua, if either is on the path; --lua ''
+skips it). um.lua is slow: try it with --scale 0.01.
+
+For each image it prints um-profile's count of each op, then a line
+per implementation, tab-separated:
+  image  implementation  seconds  instructions  instructions/s  output
+where seconds is the least over the trials, instructions is um's
+count, and output is ok or DIFFERS (from um's). --out also writes the
+lines to FILE, to diff between commits. Exits 1 if any output differed.
+"""
+
+import hashlib
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.dont_write_bytecode = True  # keep __pycache__ out of the tree
+import umasm
+
+cflags = ['-std=gnu99', '-W', '-Wall', '-g2', '-O2']
+builds = [('um', []), ('um-switch', ['-DUM_SWITCH']),
+          ('um-profile', ['-DUM_PROFILE'])]
+
+def build(here, directory):
+    for name, flags in builds:
+        subprocess.check_call(['gcc'] + cflags + flags
+                              + [os.path.join(here, 'um.c'),
+                                 '-o', os.path.join(directory, name)])
+
+def run(command, path):
+    "Run command on the image at path: its seconds, stdout and stderr."
+    start = time.time()
+    p = subprocess.Popen(command + [path], stdin=subprocess.DEVNULL,
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out, err = p.communicate()
+    seconds = time.time() - start
+    if p.returncode != 0:
+        sys.exit('%s failed on %s: %s'
+                 % (' '.join(command), path, err.decode(errors='replace')))
+    return seconds, out, err.decode()
+
+def instructions(stats):
+    "The count in --stats's report."
+    return int(stats.split()[0])
+
+def main(argv):
+    usage = ('Usage: python3 umbench.py [--scale S] [--trials N] '
+             '[--lua COMMAND] [--out FILE] [--dir DIR]')
+    scale, trials, out, directory = 1.0, 3, None, None
+    lua = shutil.which('lua5.2') or shutil.which('lua')
+    while argv[:1] and argv[0].startswith('--'):
+        if len(argv) < 2:
+            sys.exit(usage)
+        option, value = argv[0], argv[1]
+        argv = argv[2:]
+        if option == '--scale':
+            scale = float(value)
+        elif option == '--trials':
+            trials = int(value)
+        elif option == '--lua':
+            lua = value
+        elif option == '--out':
+            out = value
+        elif option == '--dir':
+            directory = value
+        else:
+            sys.exit(usage)
+    if argv:
+        sys.exit(usage)
+
+    if directory is None:
+        with tempfile.TemporaryDirectory(prefix='umbench-') as directory:
+            differed = bench(directory, scale, trials, lua, out)
+    else:
+        os.makedirs(directory, exist_ok=True)
+        differed = bench(directory, scale, trials, lua, out)
+    sys.exit(1 if differed else 0)
+
+def bench(directory, scale, trials, lua, out):
+    "Build and run everything in directory; whether any output differed."
+    here = os.path.dirname(os.path.abspath(__file__))
+    build(here, directory)
+    um, um_switch, um_profile = [os.path.join(directory, name)
+                                 for name, _ in builds]
+    implementations = [('um', [um]),
+                       ('um --interpret', [um, '--interpret']),
+                       ('um-switch', [um_switch]),
+                       ('um-switch --interpret', [um_switch, '--interpret'])]
+    if lua:
+        implementations.append(('um.lua',
+                                [lua, os.path.join(here, 'um.lua')]))
+
+    lines, differed = [], False
+    for path in umasm.generate(directory, scale):
+        image = os.path.basename(path)[:-len('.um')]
+        _, _, profile = run([um_profile, '--stats'], path)
+        print('# %s: %s' % (image, profile.rstrip().replace('\n', '\n#   ')))
+        expected, count = None, None
+        for name, command in implementations:
+            c = command + ['--stats'] if name != 'um.lua' else command
+            best = None
+            for _ in range(trials):
+                seconds, output, stats = run(c, path)
+                best = seconds if best is None else min(best, seconds)
+            digest = hashlib.md5(output).hexdigest()
+            if expected is None:
+                expected, count = digest, instructions(stats)
+            ok = digest == expected
+            differed = differed or not ok
+            line = '%s\t%s\t%.3f\t%d\t%.3g\t%s' % (
+                image, name, best, count, count / best if best else 0,
+                'ok' if ok else 'DIFFERS')
+            print(line)
+            sys.stdout.flush()
+            lines.append(line)
+    if out:
+        with open(out, 'w') as f:
+            f.write(''.join(line + '\n' for line in lines))
+    return differed
+
+if __name__ == '__main__':
+    main(sys.argv[1:])